@@ -7,9 +7,13 @@ URL:     https://github.com/dcaliste/qtorganizer-mkcal
 Source0: %{name}-%{version}.tar.gz
 BuildRequires: pkgconfig(Qt5Core)
 BuildRequires: pkgconfig(Qt5Organizer)
+BuildRequires: pkgconfig(Qt5Concurrent)
+BuildRequires: pkgconfig(Qt5Sql)
 BuildRequires: pkgconfig(libmkcal-qt5)
 BuildRequires: pkgconfig(KF5CalendarCore)
 BuildRequires: cmake
+# Change log and statistics sidecar databases.
+Requires: qt5-plugin-sqldriver-sqlite
 
 %description
 Provides a plugin to store QOrganizer items on disk
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2024 Damien Caliste <dcaliste@free.fr>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "changejournal.h"
+
+#include <KCalendarCore/ICalFormat>
+
+#include <unistd.h>
+
+// One record per line: the update operation letter, the notebook uid
+// and the iCalendar representation of the incidence, the last two
+// being base64 encoded. Removals are saved synchronously, they are
+// never journaled. A record interrupted by a crash lacks its end of line and
+// is ignored on reading.
+
+ChangeJournal::ChangeJournal(const QString &fileName)
+    : mFile(fileName)
+    , mLock(fileName + QStringLiteral(".lock"))
+{
+    // Only the death of its owner makes a lock stale,
+    // a session may keep its journal for days.
+    mLock.setStaleLockTime(0);
+}
+
+ChangeJournal::~ChangeJournal()
+{
+    mFile.close();
+}
+
+// Fail when the journal is locked by another session.
+bool ChangeJournal::open()
+{
+    if (!mLock.tryLock(0)) {
+        return false;
+    }
+    if (!mFile.open(QIODevice::ReadWrite | QIODevice::Append)) {
+        mLock.unlock();
+        return false;
+    }
+    return true;
+}
+
+bool ChangeJournal::isEmpty() const
+{
+    return mFile.size() == 0;
+}
+
+bool ChangeJournal::append(const KCalendarCore::Incidence::Ptr &incidence,
+                           const QString &notebookUid)
+{
+    KCalendarCore::ICalFormat format;
+    QByteArray record("U ");
+    record += notebookUid.toUtf8().toBase64();
+    record += ' ';
+    record += format.toICalString(incidence).toUtf8().toBase64();
+    record += '\n';
+
+    return mFile.write(record) == record.length();
+}
+
+bool ChangeJournal::sync()
+{
+    return mFile.flush() && ::fsync(mFile.handle()) == 0;
+}
+
+bool ChangeJournal::clear()
+{
+    return mFile.resize(0) && sync();
+}
+
+// Delete the journal file, once nothing is left to replay.
+void ChangeJournal::remove()
+{
+    mFile.remove();
+    mLock.unlock();
+}
+
+QList<ChangeJournal::Entry> ChangeJournal::entries() const
+{
+    QList<Entry> entries;
+
+    QFile file(mFile.fileName());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return entries;
+    }
+    KCalendarCore::ICalFormat format;
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine();
+        const QList<QByteArray> fields = line.trimmed().split(' ');
+        if (!line.endsWith('\n') || fields.count() != 3 || fields[0] != "U") {
+            continue;
+        }
+        Entry entry;
+        entry.notebookUid = QString::fromUtf8(QByteArray::fromBase64(fields[1]));
+        entry.incidence = format.fromString(QString::fromUtf8(QByteArray::fromBase64(fields[2])));
+        if (entry.incidence) {
+            entries.append(entry);
+        }
+    }
+
+    return entries;
+}
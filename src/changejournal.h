@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2024 Damien Caliste <dcaliste@free.fr>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CHANGEJOURNAL_H
+#define CHANGEJOURNAL_H
+
+#include <QFile>
+#include <QLockFile>
+#include <QList>
+
+#include <KCalendarCore/Incidence>
+
+// Append-only record of incidences modified in memory but not yet
+// saved to the storage. Every append is synced to disk before
+// returning, so the records survive a crash and can be replayed.
+// A journal belongs to one session, which holds its lock file.
+class ChangeJournal
+{
+public:
+    struct Entry
+    {
+        QString notebookUid;
+        KCalendarCore::Incidence::Ptr incidence;
+    };
+
+    ChangeJournal(const QString &fileName);
+    ~ChangeJournal();
+
+    bool open();
+    bool isEmpty() const;
+
+    bool append(const KCalendarCore::Incidence::Ptr &incidence,
+                const QString &notebookUid);
+    bool sync();
+    bool clear();
+    void remove();
+
+    QList<Entry> entries() const;
+
+private:
+    QFile mFile;
+    QLockFile mLock;
+};
+
+#endif
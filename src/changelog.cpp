@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2024 Damien Caliste <dcaliste@free.fr>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "changelog.h"
+
+#include <QSqlQuery>
+#include <QVariant>
+
+ChangeLog::ChangeLog(const QString &fileName)
+    : mConnectionName(QStringLiteral("mkcal-changes-%1").arg(quintptr(this)))
+{
+    mDatabase = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), mConnectionName);
+    mDatabase.setDatabaseName(fileName);
+}
+
+ChangeLog::~ChangeLog()
+{
+    mDatabase.close();
+    mDatabase = QSqlDatabase();
+    QSqlDatabase::removeDatabase(mConnectionName);
+}
+
+bool ChangeLog::open()
+{
+    if (!mDatabase.open()) {
+        return false;
+    }
+    // Autoincrement guarantees that sequence numbers are never
+    // reused, even after compaction.
+    QSqlQuery query(mDatabase);
+    return query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS Changes("
+                                     "Sequence INTEGER PRIMARY KEY AUTOINCREMENT, "
+                                     "Uid TEXT, Operation INTEGER, Notebook TEXT)"))
+        && query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS Compaction("
+                                     "Id INTEGER PRIMARY KEY, Sequence INTEGER)"));
+}
+
+bool ChangeLog::append(const QList<Change> &changes)
+{
+    if (changes.isEmpty()) {
+        return true;
+    }
+    if (!mDatabase.transaction()) {
+        return false;
+    }
+    QSqlQuery query(mDatabase);
+    query.prepare(QStringLiteral("INSERT INTO Changes(Uid, Operation, Notebook) "
+                                 "VALUES(:uid, :operation, :notebook)"));
+    for (const Change &change : changes) {
+        query.bindValue(QStringLiteral(":uid"), change.uid);
+        query.bindValue(QStringLiteral(":operation"), int(change.operation));
+        query.bindValue(QStringLiteral(":notebook"), change.notebookUid);
+        if (!query.exec()) {
+            mDatabase.rollback();
+            return false;
+        }
+    }
+    return mDatabase.commit();
+}
+
+qint64 ChangeLog::lastSequence()
+{
+    QSqlQuery query(mDatabase);
+    if (query.exec(QStringLiteral("SELECT seq FROM sqlite_sequence WHERE name = 'Changes'"))
+        && query.next()) {
+        return query.value(0).toLongLong();
+    }
+    return 0;
+}
+
+ChangeLog::Feed ChangeLog::changesSince(qint64 sequence)
+{
+    Feed feed;
+
+    QSqlQuery query(mDatabase);
+    qint64 compacted = 0;
+    if (query.exec(QStringLiteral("SELECT Sequence FROM Compaction WHERE Id = 0"))
+        && query.next()) {
+        compacted = query.value(0).toLongLong();
+    }
+    feed.complete = (sequence >= compacted);
+    feed.lastSequence = lastSequence();
+
+    query.prepare(QStringLiteral("SELECT Sequence, Uid, Operation, Notebook FROM Changes "
+                                 "WHERE Sequence > :sequence ORDER BY Sequence"));
+    query.bindValue(QStringLiteral(":sequence"), sequence);
+    if (!query.exec()) {
+        feed.complete = false;
+        return feed;
+    }
+    while (query.next()) {
+        Change change;
+        change.sequence = query.value(0).toLongLong();
+        change.uid = query.value(1).toString();
+        change.operation = Operation(query.value(2).toInt());
+        change.notebookUid = query.value(3).toString();
+        feed.changes.append(change);
+    }
+
+    return feed;
+}
+
+// Keep only the last maxChanges changes, recording up to which
+// sequence number changes were dropped.
+bool ChangeLog::compact(int maxChanges)
+{
+    const qint64 limit = lastSequence() - maxChanges;
+    if (limit <= 0) {
+        return true;
+    }
+    QSqlQuery query(mDatabase);
+    if (!query.exec(QStringLiteral("SELECT MIN(Sequence) FROM Changes"))
+        || !query.next() || query.value(0).toLongLong() > limit) {
+        return true;
+    }
+    if (!mDatabase.transaction()) {
+        return false;
+    }
+    query.prepare(QStringLiteral("DELETE FROM Changes WHERE Sequence <= :limit"));
+    query.bindValue(QStringLiteral(":limit"), limit);
+    if (!query.exec() || !setCompacted(limit)) {
+        mDatabase.rollback();
+        return false;
+    }
+    return mDatabase.commit();
+}
+
+// Some changes happened but could not be listed, make
+// the feeds from the current sequence incomplete.
+bool ChangeLog::markIncomplete()
+{
+    return setCompacted(lastSequence() + 1);
+}
+
+// Feeds from before sequence are incomplete. Never
+// lowered, a later compaction may drop fewer changes.
+bool ChangeLog::setCompacted(qint64 sequence)
+{
+    QSqlQuery query(mDatabase);
+    query.prepare(QStringLiteral("INSERT OR REPLACE INTO Compaction(Id, Sequence) "
+                                 "VALUES(0, MAX(:sequence, IFNULL((SELECT Sequence "
+                                 "FROM Compaction WHERE Id = 0), 0)))"));
+    query.bindValue(QStringLiteral(":sequence"), sequence);
+    return query.exec();
+}
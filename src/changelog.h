@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2024 Damien Caliste <dcaliste@free.fr>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CHANGELOG_H
+#define CHANGELOG_H
+
+#include <QString>
+#include <QList>
+#include <QMetaType>
+#include <QSqlDatabase>
+
+// Sequenced record of the changes done to a database, stored in a
+// sidecar SQLite file, so clients can ask for the changes that
+// happened since a sequence number they saw earlier.
+class ChangeLog
+{
+public:
+    enum Operation {
+        ItemAdded,
+        ItemModified,
+        ItemRemoved,
+        NotebookAdded,
+        NotebookModified,
+        NotebookRemoved
+    };
+
+    struct Change
+    {
+        qint64 sequence = 0;
+        QString uid;
+        Operation operation = ItemModified;
+        QString notebookUid;
+    };
+
+    struct Feed
+    {
+        // False when some changes after the requested sequence were
+        // compacted away, the client should then reload everything.
+        bool complete = false;
+        qint64 lastSequence = 0;
+        QList<Change> changes;
+    };
+
+    ChangeLog(const QString &fileName);
+    ~ChangeLog();
+
+    bool open();
+
+    bool append(const QList<Change> &changes);
+    Feed changesSince(qint64 sequence);
+    qint64 lastSequence();
+    bool compact(int maxChanges);
+    bool markIncomplete();
+
+private:
+    bool setCompacted(qint64 sequence);
+
+    QString mConnectionName;
+    QSqlDatabase mDatabase;
+};
+Q_DECLARE_METATYPE(ChangeLog::Feed)
+
+#endif
@@ -31,8 +31,15 @@
 
 #include "helper.h"
 
+// Read-only statistics, not stored in the notebook.
+static const QString ITEM_COUNT = QStringLiteral("itemCount");
+static const QString EARLIEST_DATE = QStringLiteral("earliestDate");
+static const QString LATEST_DATE = QStringLiteral("latestDate");
+static const QString PENDING_CHANGES = QStringLiteral("pendingChanges");
+
 QtOrganizer::QOrganizerCollection toCollection(const QString &managerUri,
-                                               const mKCal::Notebook::Ptr &nb)
+                                               const mKCal::Notebook::Ptr &nb,
+                                               const NotebookStatistics::Counters *counters)
 {
     QtOrganizer::QOrganizerCollection collection;
     collection.setId(QtOrganizer::QOrganizerCollectionId(managerUri, nb->uid().toUtf8()));
@@ -80,6 +87,12 @@ QtOrganizer::QOrganizerCollection toCollection(const QString &managerUri,
                                            nb->customProperty(key));
         }
     }
+    if (counters && !counters->stale) {
+        collection.setExtendedMetaData(ITEM_COUNT, counters->itemCount);
+        collection.setExtendedMetaData(EARLIEST_DATE, counters->earliestDate);
+        collection.setExtendedMetaData(LATEST_DATE, counters->latestDate);
+        collection.setExtendedMetaData(PENDING_CHANGES, counters->pendingUids.count());
+    }
     return collection;
 }
 
@@ -120,6 +133,9 @@ void updateNotebook(mKCal::Notebook::Ptr nb,
             nb->setAttachmentSize(it.value().toInt());
         } else if (it.key() == QStringLiteral("sharedWith")) {
             nb->setSharedWith(it.value().toStringList());
+        } else if (it.key() == ITEM_COUNT || it.key() == EARLIEST_DATE
+                   || it.key() == LATEST_DATE || it.key() == PENDING_CHANGES) {
+            continue;
         } else {
             nb->setCustomProperty(it.key().toUtf8(), it.value().toString());
         }
@@ -36,8 +36,11 @@
 
 #include <notebook.h>
 
+#include "notebookstatistics.h"
+
 QtOrganizer::QOrganizerCollection toCollection(const QString &managerUri,
-                                               const mKCal::Notebook::Ptr &nb);
+                                               const mKCal::Notebook::Ptr &nb,
+                                               const NotebookStatistics::Counters *counters = nullptr);
 
 void updateNotebook(mKCal::Notebook::Ptr nb,
                     const QtOrganizer::QOrganizerCollection &collection);
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2024 Damien Caliste <dcaliste@free.fr>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "instrumentedstorage.h"
+
+#include <QElapsedTimer>
+
+class CallTimer
+{
+public:
+    CallTimer(InstrumentedStorage::Calls *calls)
+        : mCalls(calls)
+    {
+        mTimer.start();
+    }
+    ~CallTimer()
+    {
+        mCalls->count += 1;
+        mCalls->elapsed += mTimer.nsecsElapsed();
+    }
+
+private:
+    InstrumentedStorage::Calls *mCalls;
+    QElapsedTimer mTimer;
+};
+
+InstrumentedStorage::InstrumentedStorage()
+{
+}
+
+InstrumentedStorage::InstrumentedStorage(const mKCal::SqliteStorage::Ptr &storage)
+    : mStorage(storage)
+{
+}
+
+mKCal::SqliteStorage *InstrumentedStorage::operator->() const
+{
+    return mStorage.data();
+}
+
+mKCal::SqliteStorage *InstrumentedStorage::data() const
+{
+    return mStorage.data();
+}
+
+InstrumentedStorage::operator bool() const
+{
+    return !mStorage.isNull();
+}
+
+bool InstrumentedStorage::load(const QString &uid)
+{
+    CallTimer timer(&mCalls["load(uid)"]);
+    return mStorage->load(uid);
+}
+
+bool InstrumentedStorage::load(const QDate &start, const QDate &end)
+{
+    CallTimer timer(&mCalls["load(range)"]);
+    return mStorage->load(start, end);
+}
+
+bool InstrumentedStorage::loadIncidenceInstance(const QString &instanceIdentifier)
+{
+    CallTimer timer(&mCalls["loadIncidenceInstance"]);
+    return mStorage->loadIncidenceInstance(instanceIdentifier);
+}
+
+bool InstrumentedStorage::loadNotebookIncidences(const QString &notebookUid)
+{
+    CallTimer timer(&mCalls["loadNotebookIncidences"]);
+    return mStorage->loadNotebookIncidences(notebookUid);
+}
+
+bool InstrumentedStorage::save(mKCal::ExtendedStorage::DeleteAction deleteAction)
+{
+    CallTimer timer(&mCalls["save"]);
+    return mStorage->save(deleteAction);
+}
+
+mKCal::Notebook::List InstrumentedStorage::notebooks()
+{
+    CallTimer timer(&mCalls["notebooks"]);
+    return mStorage->notebooks();
+}
+
+bool InstrumentedStorage::purgeDeletedIncidences(const KCalendarCore::Incidence::List &list,
+                                                 const QString &notebookUid)
+{
+    CallTimer timer(&mCalls["purgeDeletedIncidences"]);
+    return mStorage->purgeDeletedIncidences(list, notebookUid);
+}
+
+void InstrumentedStorage::resetCalls()
+{
+    mCalls.clear();
+}
+
+InstrumentedStorage::Breakdown InstrumentedStorage::calls() const
+{
+    return mCalls;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2024 Damien Caliste <dcaliste@free.fr>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef INSTRUMENTEDSTORAGE_H
+#define INSTRUMENTEDSTORAGE_H
+
+#include <QMap>
+#include <QByteArray>
+
+#include <sqlitestorage.h>
+
+// Storage wrapper counting and timing the potentially costly calls,
+// made with '.', while other calls go through '->' unchanged.
+class InstrumentedStorage
+{
+public:
+    struct Calls
+    {
+        int count = 0;
+        qint64 elapsed = 0; // in ns
+    };
+    typedef QMap<QByteArray, Calls> Breakdown;
+
+    InstrumentedStorage();
+    InstrumentedStorage(const mKCal::SqliteStorage::Ptr &storage);
+
+    mKCal::SqliteStorage *operator->() const;
+    mKCal::SqliteStorage *data() const;
+    explicit operator bool() const;
+
+    bool load(const QString &uid);
+    bool load(const QDate &start, const QDate &end);
+    bool loadIncidenceInstance(const QString &instanceIdentifier);
+    bool loadNotebookIncidences(const QString &notebookUid);
+    bool save(mKCal::ExtendedStorage::DeleteAction deleteAction);
+    mKCal::Notebook::List notebooks();
+    bool purgeDeletedIncidences(const KCalendarCore::Incidence::List &list,
+                                const QString &notebookUid);
+
+    // Calls made since the last reset.
+    void resetCalls();
+    Breakdown calls() const;
+
+private:
+    mKCal::SqliteStorage::Ptr mStorage;
+    Breakdown mCalls;
+};
+
+#endif
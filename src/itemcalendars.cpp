@@ -48,8 +48,14 @@
 #include <QtOrganizer/QOrganizerTodoTime>
 #include <QtOrganizer/QOrganizerTodoProgress>
 #include <QtOrganizer/QOrganizerJournalTime>
+#include <QtOrganizer/QOrganizerEventAttendee>
+#include <QtOrganizer/QOrganizerItemExtendedDetail>
 
 #include <QtOrganizer/QOrganizerItemCollectionFilter>
+#include <QtOrganizer/QOrganizerItemIdFilter>
+#include <QtOrganizer/QOrganizerItemDetailFieldFilter>
+#include <QtOrganizer/QOrganizerItemIntersectionFilter>
+#include <QtOrganizer/QOrganizerItemUnionFilter>
 #include <QtOrganizer/QOrganizerEventOccurrence>
 #include <QtOrganizer/QOrganizerTodoOccurrence>
 #include <QtOrganizer/QOrganizerManagerEngine>
@@ -59,12 +65,15 @@
 #include <KCalendarCore/Journal>
 #include <KCalendarCore/OccurrenceIterator>
 
+#include "tracer.h"
+
 using namespace QtOrganizer;
 
-static KCalendarCore::Alarm::Ptr toAlarm(KCalendarCore::Incidence::Ptr incidence,
-                                         const QOrganizerItemReminder &reminder)
+// Create a detached alarm, not yet attached to any incidence,
+// so it can be compared with the existing ones first.
+static KCalendarCore::Alarm::Ptr toAlarm(const QOrganizerItemReminder &reminder)
 {
-    KCalendarCore::Alarm::Ptr alarm = incidence->newAlarm();
+    KCalendarCore::Alarm::Ptr alarm(new KCalendarCore::Alarm(nullptr));
     alarm->setStartOffset(KCalendarCore::Duration(reminder.secondsBeforeStart()));
     alarm->setRepeatCount(reminder.repetitionCount());
     alarm->setSnoozeTime(KCalendarCore::Duration(reminder.repetitionDelay()));
@@ -72,6 +81,20 @@ static KCalendarCore::Alarm::Ptr toAlarm(KCalendarCore::Incidence::Ptr incidence
     return alarm;
 }
 
+static QOrganizerItemDetail::DetailType reminderType(const KCalendarCore::Alarm::Ptr &alarm)
+{
+    switch (alarm->type()) {
+    case KCalendarCore::Alarm::Audio:
+        return QOrganizerItemDetail::TypeAudibleReminder;
+    case KCalendarCore::Alarm::Email:
+        return QOrganizerItemDetail::TypeEmailReminder;
+    case KCalendarCore::Alarm::Display:
+        return QOrganizerItemDetail::TypeVisualReminder;
+    default:
+        return QOrganizerItemDetail::TypeUndefined;
+    }
+}
+
 static KCalendarCore::RecurrenceRule* toRecurrenceRule(const KCalendarCore::Incidence &incidence,
                                                        const QOrganizerRecurrenceRule &rule)
 {
@@ -137,211 +160,359 @@ static KCalendarCore::RecurrenceRule* toRecurrenceRule(const KCalendarCore::Inci
     return r;
 }
 
+static bool inMask(const QList<QOrganizerItemDetail::DetailType> &detailMask,
+                   QOrganizerItemDetail::DetailType type)
+{
+    return detailMask.isEmpty() || detailMask.contains(type);
+}
+
+static KCalendarCore::Attendee toAttendee(const QOrganizerEventAttendee &attendee)
+{
+    KCalendarCore::Attendee::PartStat part;
+    switch (attendee.participationStatus()) {
+    case QOrganizerEventAttendee::StatusAccepted:
+        part = KCalendarCore::Attendee::Accepted;
+        break;
+    case QOrganizerEventAttendee::StatusDeclined:
+        part = KCalendarCore::Attendee::Declined;
+        break;
+    case QOrganizerEventAttendee::StatusTentative:
+        part = KCalendarCore::Attendee::Tentative;
+        break;
+    case QOrganizerEventAttendee::StatusDelegated:
+        part = KCalendarCore::Attendee::Delegated;
+        break;
+    case QOrganizerEventAttendee::StatusInProcess:
+        part = KCalendarCore::Attendee::InProcess;
+        break;
+    case QOrganizerEventAttendee::StatusCompleted:
+        part = KCalendarCore::Attendee::Completed;
+        break;
+    default:
+        part = KCalendarCore::Attendee::NeedsAction;
+    }
+    KCalendarCore::Attendee::Role role;
+    switch (attendee.participationRole()) {
+    case QOrganizerEventAttendee::RoleRequiredParticipant:
+        role = KCalendarCore::Attendee::ReqParticipant;
+        break;
+    case QOrganizerEventAttendee::RoleOptionalParticipant:
+        role = KCalendarCore::Attendee::OptParticipant;
+        break;
+    case QOrganizerEventAttendee::RoleNonParticipant:
+        role = KCalendarCore::Attendee::NonParticipant;
+        break;
+    case QOrganizerEventAttendee::RoleChairperson:
+        role = KCalendarCore::Attendee::Chair;
+        break;
+    default:
+        role = KCalendarCore::Attendee::ReqParticipant;
+    }
+    return KCalendarCore::Attendee(attendee.name(), attendee.emailAddress(),
+                                   false, part, role, attendee.attendeeId());
+}
+
+// Compare only the attendee properties that are mapped to
+// QOrganizerEventAttendee, the other ones are not under our control.
+static bool sameAttendees(const KCalendarCore::Attendee::List &list1,
+                          const KCalendarCore::Attendee::List &list2)
+{
+    if (list1.count() != list2.count()) {
+        return false;
+    }
+    for (int i = 0; i < list1.count(); i++) {
+        const KCalendarCore::Attendee &att1 = list1[i];
+        const KCalendarCore::Attendee &att2 = list2[i];
+        if (att1.name() != att2.name()
+            || att1.email() != att2.email()
+            || att1.status() != att2.status()
+            || att1.role() != att2.role()
+            || att1.uid() != att2.uid()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool sameAlarms(const KCalendarCore::Alarm::List &list1,
+                       const KCalendarCore::Alarm::List &list2)
+{
+    if (list1.count() != list2.count()) {
+        return false;
+    }
+    for (int i = 0; i < list1.count(); i++) {
+        if (!(*list1[i] == *list2[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool sameRules(const KCalendarCore::RecurrenceRule::List &list1,
+                      const KCalendarCore::RecurrenceRule::List &list2)
+{
+    if (list1.count() != list2.count()) {
+        return false;
+    }
+    for (int i = 0; i < list1.count(); i++) {
+        if (!(*list1[i] == *list2[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void setRecurrence(KCalendarCore::Recurrence *recur,
+                          const KCalendarCore::Incidence &incidence,
+                          const QOrganizerItemRecurrence &recurrence)
+{
+    for (const QOrganizerRecurrenceRule &rule : recurrence.recurrenceRules()) {
+        recur->addRRule(toRecurrenceRule(incidence, rule));
+    }
+    for (const QDate &date : recurrence.recurrenceDates()) {
+        if (incidence.allDay()) {
+            recur->addRDate(date);
+        } else {
+            QDateTime dt(incidence.dtStart());
+            dt.setDate(date);
+            recur->addRDateTime(dt);
+        }
+    }
+    for (const QOrganizerRecurrenceRule &rule : recurrence.exceptionRules()) {
+        recur->addExRule(toRecurrenceRule(incidence, rule));
+    }
+    for (const QDate &date : recurrence.exceptionDates()) {
+        if (incidence.allDay()) {
+            recur->addExDate(date);
+        } else {
+            QDateTime dt(incidence.dtStart());
+            dt.setDate(date);
+            recur->addExDateTime(dt);
+        }
+    }
+}
+
+static bool sameRecurrence(const KCalendarCore::Recurrence &recur1,
+                           const KCalendarCore::Recurrence &recur2)
+{
+    return sameRules(recur1.rRules(), recur2.rRules())
+        && sameRules(recur1.exRules(), recur2.exRules())
+        && recur1.rDates() == recur2.rDates()
+        && recur1.rDateTimes() == recur2.rDateTimes()
+        && recur1.exDates() == recur2.exDates()
+        && recur1.exDateTimes() == recur2.exDateTimes();
+}
+
+static void setChanged(QSet<QOrganizerItemDetail::DetailType> *changes,
+                       QOrganizerItemDetail::DetailType type)
+{
+    if (changes && type != QOrganizerItemDetail::TypeUndefined) {
+        changes->insert(type);
+    }
+}
+
+// Every setter of KCalendarCore marks the field as dirty and the
+// incidence as updated, even when the value is unchanged. Only call
+// them when the value actually differs, so mKCal does not rewrite
+// unchanged incidences or fields.
 static void updateIncidence(KCalendarCore::Incidence::Ptr incidence,
                             const QOrganizerItem &item,
-                            const QList<QOrganizerItemDetail::DetailType> &detailMask = QList<QOrganizerItemDetail::DetailType>())
+                            const QList<QOrganizerItemDetail::DetailType> &detailMask = QList<QOrganizerItemDetail::DetailType>(),
+                            QSet<QOrganizerItemDetail::DetailType> *changes = nullptr)
 {
-    if (detailMask.isEmpty()
-        || detailMask.contains(QOrganizerItemDetail::TypeDisplayLabel)) {
+    if (inMask(detailMask, QOrganizerItemDetail::TypeDisplayLabel)
+        && incidence->summary() != item.displayLabel()) {
         incidence->setSummary(item.displayLabel());
+        setChanged(changes, QOrganizerItemDetail::TypeDisplayLabel);
     }
-    if (detailMask.isEmpty()
-        || detailMask.contains(QOrganizerItemDetail::TypeDescription)) {
+    if (inMask(detailMask, QOrganizerItemDetail::TypeDescription)
+        && incidence->description() != item.description()) {
         incidence->setDescription(item.description());
+        setChanged(changes, QOrganizerItemDetail::TypeDescription);
     }
-    if (detailMask.isEmpty()
-        || detailMask.contains(QOrganizerItemDetail::TypeComment)) {
+    if (inMask(detailMask, QOrganizerItemDetail::TypeComment)
+        && incidence->comments() != item.comments()) {
         incidence->clearComments();
+        setChanged(changes, QOrganizerItemDetail::TypeComment);
         for (const QString &comment : item.comments()) {
             incidence->addComment(comment);
         }
     }
+    KCalendarCore::Alarm::List alarms;
+    for (const KCalendarCore::Alarm::Ptr &alarm : incidence->alarms()) {
+        const QOrganizerItemDetail::DetailType type = reminderType(alarm);
+        if (type == QOrganizerItemDetail::TypeUndefined
+            || !inMask(detailMask, type)) {
+            alarms.append(alarm);
+        }
+    }
+    KCalendarCore::Attendee::List attendees;
     for (const QOrganizerItemDetail &detail : item.details()) {
+        if (!inMask(detailMask, detail.type())) {
+            continue;
+        }
         switch (detail.type()) {
-        case QOrganizerItemDetail::TypeClassification:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
-                QOrganizerItemClassification classification(detail);
-                switch (classification.classification()) {
-                case QOrganizerItemClassification::AccessPrivate:
-                    incidence->setSecrecy(KCalendarCore::Incidence::SecrecyPrivate);
-                    break;
-                case QOrganizerItemClassification::AccessConfidential:
-                    incidence->setSecrecy(KCalendarCore::Incidence::SecrecyConfidential);
-                    break;
-                default:
-                    incidence->setSecrecy(KCalendarCore::Incidence::SecrecyPublic);
-                    break;
-                }
+        case QOrganizerItemDetail::TypeClassification: {
+            KCalendarCore::Incidence::Secrecy secrecy;
+            switch (QOrganizerItemClassification(detail).classification()) {
+            case QOrganizerItemClassification::AccessPrivate:
+                secrecy = KCalendarCore::Incidence::SecrecyPrivate;
+                break;
+            case QOrganizerItemClassification::AccessConfidential:
+                secrecy = KCalendarCore::Incidence::SecrecyConfidential;
+                break;
+            default:
+                secrecy = KCalendarCore::Incidence::SecrecyPublic;
+                break;
+            }
+            if (incidence->secrecy() != secrecy) {
+                incidence->setSecrecy(secrecy);
+                setChanged(changes, QOrganizerItemDetail::TypeClassification);
             }
             break;
-        case QOrganizerItemDetail::TypeLocation:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
-                QOrganizerItemLocation loc(detail);
+        }
+        case QOrganizerItemDetail::TypeLocation: {
+            QOrganizerItemLocation loc(detail);
+            if (incidence->location() != loc.label()) {
                 incidence->setLocation(loc.label());
+                setChanged(changes, QOrganizerItemDetail::TypeLocation);
+            }
+            if (incidence->geoLatitude() != loc.latitude()) {
                 incidence->setGeoLatitude(loc.latitude());
+                setChanged(changes, QOrganizerItemDetail::TypeLocation);
+            }
+            if (incidence->geoLongitude() != loc.longitude()) {
                 incidence->setGeoLongitude(loc.longitude());
+                setChanged(changes, QOrganizerItemDetail::TypeLocation);
             }
             break;
-        case QOrganizerItemDetail::TypePriority:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
-                QOrganizerItemPriority priority(detail);
+        }
+        case QOrganizerItemDetail::TypePriority: {
+            QOrganizerItemPriority priority(detail);
+            if (incidence->priority() != priority.priority()) {
                 incidence->setPriority(priority.priority());
+                setChanged(changes, QOrganizerItemDetail::TypePriority);
             }
             break;
-        case QOrganizerItemDetail::TypeTimestamp:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
-                QOrganizerItemTimestamp stamp(detail);
+        }
+        case QOrganizerItemDetail::TypeTimestamp: {
+            QOrganizerItemTimestamp stamp(detail);
+            if (incidence->created() != stamp.created()) {
                 incidence->setCreated(stamp.created());
+                setChanged(changes, QOrganizerItemDetail::TypeTimestamp);
+            }
+            if (incidence->lastModified() != stamp.lastModified()) {
                 incidence->setLastModified(stamp.lastModified());
+                setChanged(changes, QOrganizerItemDetail::TypeTimestamp);
             }
             break;
-        case QOrganizerItemDetail::TypeVersion:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
-                QOrganizerItemVersion stamp(detail);
+        }
+        case QOrganizerItemDetail::TypeVersion: {
+            QOrganizerItemVersion stamp(detail);
+            if (incidence->revision() != stamp.version()) {
                 incidence->setRevision(stamp.version());
+                setChanged(changes, QOrganizerItemDetail::TypeVersion);
             }
             break;
-        case QOrganizerItemDetail::TypeAudibleReminder:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
-                QOrganizerItemAudibleReminder reminder(detail);
-                KCalendarCore::Alarm::Ptr alarm = toAlarm(incidence, reminder);
-                alarm->setAudioAlarm(reminder.dataUrl().toString());
-            }
+        }
+        case QOrganizerItemDetail::TypeAudibleReminder: {
+            QOrganizerItemAudibleReminder reminder(detail);
+            KCalendarCore::Alarm::Ptr alarm = toAlarm(reminder);
+            alarm->setAudioAlarm(reminder.dataUrl().toString());
+            alarms.append(alarm);
             break;
-        case QOrganizerItemDetail::TypeEmailReminder:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
-                QOrganizerItemEmailReminder reminder(detail);
-                KCalendarCore::Alarm::Ptr alarm = toAlarm(incidence, reminder);
-                KCalendarCore::Person::List recipients;
-                for (const QString &recipient : reminder.recipients()) {
-                    recipients.append(KCalendarCore::Person::fromFullName(recipient));
-                }
-                alarm->setEmailAlarm(reminder.subject(), reminder.body(), recipients);
+        }
+        case QOrganizerItemDetail::TypeEmailReminder: {
+            QOrganizerItemEmailReminder reminder(detail);
+            KCalendarCore::Alarm::Ptr alarm = toAlarm(reminder);
+            KCalendarCore::Person::List recipients;
+            for (const QString &recipient : reminder.recipients()) {
+                recipients.append(KCalendarCore::Person::fromFullName(recipient));
             }
+            alarm->setEmailAlarm(reminder.subject(), reminder.body(), recipients);
+            alarms.append(alarm);
             break;
-        case QOrganizerItemDetail::TypeVisualReminder:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
-                QOrganizerItemVisualReminder reminder(detail);
-                KCalendarCore::Alarm::Ptr alarm = toAlarm(incidence, reminder);
-                alarm->setDisplayAlarm(reminder.message());
-            }
+        }
+        case QOrganizerItemDetail::TypeVisualReminder: {
+            QOrganizerItemVisualReminder reminder(detail);
+            KCalendarCore::Alarm::Ptr alarm = toAlarm(reminder);
+            alarm->setDisplayAlarm(reminder.message());
+            alarms.append(alarm);
             break;
-        case QOrganizerItemDetail::TypeEventRsvp:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
-                QOrganizerEventRsvp rsvp(detail);
-                incidence->setOrganizer(KCalendarCore::Person(rsvp.organizerName(),
-                                                              rsvp.organizerEmail()));
+        }
+        case QOrganizerItemDetail::TypeEventRsvp: {
+            QOrganizerEventRsvp rsvp(detail);
+            const KCalendarCore::Person organizer(rsvp.organizerName(),
+                                                  rsvp.organizerEmail());
+            if (!(incidence->organizer() == organizer)) {
+                incidence->setOrganizer(organizer);
+                setChanged(changes, QOrganizerItemDetail::TypeEventRsvp);
             }
             break;
+        }
         case QOrganizerItemDetail::TypeEventAttendee:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
-                QOrganizerEventAttendee attendee(detail);
-                KCalendarCore::Attendee::PartStat part;
-                switch (attendee.participationStatus()) {
-                case QOrganizerEventAttendee::StatusAccepted:
-                    part = KCalendarCore::Attendee::Accepted;
-                    break;
-                case QOrganizerEventAttendee::StatusDeclined:
-                    part = KCalendarCore::Attendee::Declined;
-                    break;
-                case QOrganizerEventAttendee::StatusTentative:
-                    part = KCalendarCore::Attendee::Tentative;
-                    break;
-                case QOrganizerEventAttendee::StatusDelegated:
-                    part = KCalendarCore::Attendee::Delegated;
-                    break;
-                case QOrganizerEventAttendee::StatusInProcess:
-                    part = KCalendarCore::Attendee::InProcess;
-                    break;
-                case QOrganizerEventAttendee::StatusCompleted:
-                    part = KCalendarCore::Attendee::Completed;
-                    break;
-                default:
-                    part = KCalendarCore::Attendee::NeedsAction;
-                }
-                KCalendarCore::Attendee::Role role;
-                switch (attendee.participationRole()) {
-                case QOrganizerEventAttendee::RoleRequiredParticipant:
-                    role = KCalendarCore::Attendee::ReqParticipant;
-                    break;
-                case QOrganizerEventAttendee::RoleOptionalParticipant:
-                    role = KCalendarCore::Attendee::OptParticipant;
-                    break;
-                case QOrganizerEventAttendee::RoleNonParticipant:
-                    role = KCalendarCore::Attendee::NonParticipant;
-                    break;
-                case QOrganizerEventAttendee::RoleChairperson:
-                    role = KCalendarCore::Attendee::Chair;
-                    break;
-                default:
-                    role = KCalendarCore::Attendee::ReqParticipant;
-                }
-                KCalendarCore::Attendee att(attendee.name(), attendee.emailAddress(),
-                                            false, part, role, attendee.attendeeId());
-                incidence->addAttendee(att);
-            }
-            break;
-        case QOrganizerItemDetail::TypeRecurrence:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
-                QOrganizerItemRecurrence recurrence(detail);
-                KCalendarCore::Recurrence *recur = incidence->recurrence();
-                for (const QOrganizerRecurrenceRule &rule : recurrence.recurrenceRules()) {
-                    recur->addRRule(toRecurrenceRule(*incidence, rule));
-                }
-                for (const QDate &date : recurrence.recurrenceDates()) {
-                    if (incidence->allDay()) {
-                        recur->addRDate(date);
-                    } else {
-                        QDateTime dt(incidence->dtStart());
-                        dt.setDate(date);
-                        recur->addRDateTime(dt);
-                    }
-                }
-                for (const QOrganizerRecurrenceRule &rule : recurrence.exceptionRules()) {
-                    recur->addExRule(toRecurrenceRule(*incidence, rule));
-                }
-                for (const QDate &date : recurrence.exceptionDates()) {
-                    if (incidence->allDay()) {
-                        recur->addExDate(date);
-                    } else {
-                        QDateTime dt(incidence->dtStart());
-                        dt.setDate(date);
-                        recur->addExDateTime(dt);
-                    }
-                }
-            }
+            attendees.append(toAttendee(QOrganizerEventAttendee(detail)));
             break;
         default:
             break;
         }
     }
+    if (!sameAlarms(incidence->alarms(), alarms)) {
+        for (const KCalendarCore::Alarm::Ptr &alarm : incidence->alarms() + alarms) {
+            setChanged(changes, reminderType(alarm));
+        }
+        incidence->clearAlarms();
+        for (const KCalendarCore::Alarm::Ptr &alarm : alarms) {
+            alarm->setParent(incidence.data());
+            incidence->addAlarm(alarm);
+        }
+    }
+    // Attendees are only exposed for events, don't drop
+    // the ones of other incidence types if none are given.
+    if (inMask(detailMask, QOrganizerItemDetail::TypeEventAttendee)
+        && (incidence->type() == KCalendarCore::Incidence::TypeEvent
+            || !attendees.isEmpty())
+        && !sameAttendees(incidence->attendees(), attendees)) {
+        incidence->setAttendees(attendees);
+        setChanged(changes, QOrganizerItemDetail::TypeEventAttendee);
+    }
+    if (inMask(detailMask, QOrganizerItemDetail::TypeRecurrence)) {
+        KCalendarCore::Recurrence recur;
+        recur.setStartDateTime(incidence->dtStart(), incidence->allDay());
+        setRecurrence(&recur, *incidence,
+                      item.detail(QOrganizerItemDetail::TypeRecurrence));
+        if (!sameRecurrence(*incidence->recurrence(), recur)) {
+            incidence->recurrence()->clear();
+            setChanged(changes, QOrganizerItemDetail::TypeRecurrence);
+            setRecurrence(incidence->recurrence(), *incidence,
+                          item.detail(QOrganizerItemDetail::TypeRecurrence));
+        }
+    }
 }
 
 static void updateEvent(KCalendarCore::Event::Ptr event,
                         const QOrganizerItem &item,
-                        const QList<QOrganizerItemDetail::DetailType> &detailMask = QList<QOrganizerItemDetail::DetailType>())
+                        const QList<QOrganizerItemDetail::DetailType> &detailMask = QList<QOrganizerItemDetail::DetailType>(),
+                        QSet<QOrganizerItemDetail::DetailType> *changes = nullptr)
 {
-    updateIncidence(event, item, detailMask);
+    updateIncidence(event, item, detailMask, changes);
     for (const QOrganizerItemDetail &detail : item.details()) {
         switch (detail.type()) {
         case QOrganizerItemDetail::TypeEventTime:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
+            if (inMask(detailMask, detail.type())) {
                 QOrganizerEventTime time(detail);
-                event->setDtStart(time.startDateTime());
-                event->setDtEnd(time.endDateTime());
-                event->setAllDay(time.isAllDay());
+                if (event->dtStart() != time.startDateTime()) {
+                    event->setDtStart(time.startDateTime());
+                    setChanged(changes, QOrganizerItemDetail::TypeEventTime);
+                }
+                if (event->dtEnd() != time.endDateTime()) {
+                    event->setDtEnd(time.endDateTime());
+                    setChanged(changes, QOrganizerItemDetail::TypeEventTime);
+                }
+                if (event->allDay() != time.isAllDay()) {
+                    event->setAllDay(time.isAllDay());
+                    setChanged(changes, QOrganizerItemDetail::TypeEventTime);
+                }
             }
             break;
         default:
@@ -352,26 +523,40 @@ static void updateEvent(KCalendarCore::Event::Ptr event,
 
 static void updateTodo(KCalendarCore::Todo::Ptr todo,
                        const QOrganizerItem &item,
-                       const QList<QOrganizerItemDetail::DetailType> &detailMask = QList<QOrganizerItemDetail::DetailType>())
+                       const QList<QOrganizerItemDetail::DetailType> &detailMask = QList<QOrganizerItemDetail::DetailType>(),
+                       QSet<QOrganizerItemDetail::DetailType> *changes = nullptr)
 {
-    updateIncidence(todo, item, detailMask);
+    updateIncidence(todo, item, detailMask, changes);
     for (const QOrganizerItemDetail &detail : item.details()) {
         switch (detail.type()) {
         case QOrganizerItemDetail::TypeTodoTime:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
+            if (inMask(detailMask, detail.type())) {
                 QOrganizerTodoTime time(detail);
-                todo->setDtStart(time.startDateTime());
-                todo->setDtDue(time.dueDateTime());
-                todo->setAllDay(time.isAllDay());
+                if (todo->dtStart() != time.startDateTime()) {
+                    todo->setDtStart(time.startDateTime());
+                    setChanged(changes, QOrganizerItemDetail::TypeTodoTime);
+                }
+                if (todo->dtDue() != time.dueDateTime()) {
+                    todo->setDtDue(time.dueDateTime());
+                    setChanged(changes, QOrganizerItemDetail::TypeTodoTime);
+                }
+                if (todo->allDay() != time.isAllDay()) {
+                    todo->setAllDay(time.isAllDay());
+                    setChanged(changes, QOrganizerItemDetail::TypeTodoTime);
+                }
             }
             break;
         case QOrganizerItemDetail::TypeTodoProgress:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
+            if (inMask(detailMask, detail.type())) {
                 QOrganizerTodoProgress progress(detail);
-                todo->setCompleted(progress.finishedDateTime());
-                todo->setPercentComplete(progress.percentageComplete());
+                if (todo->completed() != progress.finishedDateTime()) {
+                    todo->setCompleted(progress.finishedDateTime());
+                    setChanged(changes, QOrganizerItemDetail::TypeTodoProgress);
+                }
+                if (todo->percentComplete() != progress.percentageComplete()) {
+                    todo->setPercentComplete(progress.percentageComplete());
+                    setChanged(changes, QOrganizerItemDetail::TypeTodoProgress);
+                }
             }
             break;
         default:
@@ -382,16 +567,19 @@ static void updateTodo(KCalendarCore::Todo::Ptr todo,
 
 static void updateJournal(KCalendarCore::Journal::Ptr journal,
                           const QOrganizerItem &item,
-                          const QList<QOrganizerItemDetail::DetailType> &detailMask = QList<QOrganizerItemDetail::DetailType>())
+                          const QList<QOrganizerItemDetail::DetailType> &detailMask = QList<QOrganizerItemDetail::DetailType>(),
+                          QSet<QOrganizerItemDetail::DetailType> *changes = nullptr)
 {
-    updateIncidence(journal, item, detailMask);
+    updateIncidence(journal, item, detailMask, changes);
     for (const QOrganizerItemDetail &detail : item.details()) {
         switch (detail.type()) {
         case QOrganizerItemDetail::TypeJournalTime:
-            if (detailMask.isEmpty()
-                || detailMask.contains(detail.type())) {
+            if (inMask(detailMask, detail.type())) {
                 QOrganizerJournalTime time(detail);
-                journal->setDtStart(time.entryDateTime());
+                if (journal->dtStart() != time.entryDateTime()) {
+                    journal->setDtStart(time.entryDateTime());
+                    setChanged(changes, QOrganizerItemDetail::TypeJournalTime);
+                }
             }
             break;
         default:
@@ -737,36 +925,396 @@ static void toItemJournal(QOrganizerItem *item,
 ItemCalendars::ItemCalendars(const QTimeZone &timezone)
     : mKCal::ExtendedCalendar(timezone)
 {
+    registerObserver(this);
 }
 
-QOrganizerItem ItemCalendars::item(const QOrganizerItemId &id,
-                                   const QList<QOrganizerItemDetail::DetailType> &details) const
+ItemCalendars::~ItemCalendars()
+{
+    unregisterObserver(this);
+}
+
+// Number of entries held by the participant
+// index and the changed detail tracking.
+int ItemCalendars::indexEntryCount() const
+{
+    int count = mChangedDetails.count() + mIndexedOrganizers.count();
+    for (const QStringList &emails : mIndexedAttendees) {
+        count += emails.count();
+    }
+    return count;
+}
+
+void ItemCalendars::calendarIncidenceAdded(const KCalendarCore::Incidence::Ptr &incidence)
+{
+    indexIncidence(incidence);
+}
+
+void ItemCalendars::calendarIncidenceChanged(const KCalendarCore::Incidence::Ptr &incidence)
+{
+    unindexIncidence(incidence->instanceIdentifier());
+    indexIncidence(incidence);
+}
+
+void ItemCalendars::calendarIncidenceDeleted(const KCalendarCore::Incidence::Ptr &incidence,
+                                             const KCalendarCore::Calendar *calendar)
+{
+    Q_UNUSED(calendar);
+
+    unindexIncidence(incidence->instanceIdentifier());
+}
+
+void ItemCalendars::indexIncidence(const KCalendarCore::Incidence::Ptr &incidence)
+{
+    const QString id = incidence->instanceIdentifier();
+
+    QStringList emails;
+    for (const KCalendarCore::Attendee &attendee : incidence->attendees()) {
+        const QString email = attendee.email().toLower();
+        if (!email.isEmpty() && !emails.contains(email)) {
+            emails.append(email);
+            mAttendeeIndex[email].insert(id);
+        }
+    }
+    if (!emails.isEmpty()) {
+        mIndexedAttendees.insert(id, emails);
+    }
+
+    const QString organizer = incidence->organizer().email().toLower();
+    if (!organizer.isEmpty()) {
+        mOrganizerIndex[organizer].insert(id);
+        mIndexedOrganizers.insert(id, organizer);
+    }
+}
+
+static void removeFromIndex(QHash<QString, QSet<QString>> *index,
+                            const QString &email, const QString &id)
+{
+    QHash<QString, QSet<QString>>::Iterator it = index->find(email);
+    if (it != index->end()) {
+        it->remove(id);
+        if (it->isEmpty()) {
+            index->erase(it);
+        }
+    }
+}
+
+void ItemCalendars::unindexIncidence(const QString &instanceIdentifier)
+{
+    for (const QString &email : mIndexedAttendees.take(instanceIdentifier)) {
+        removeFromIndex(&mAttendeeIndex, email, instanceIdentifier);
+    }
+    const QString organizer = mIndexedOrganizers.take(instanceIdentifier);
+    if (!organizer.isEmpty()) {
+        removeFromIndex(&mOrganizerIndex, organizer, instanceIdentifier);
+    }
+}
+
+// Return true when the filter can only match incidences listed in
+// candidates, as read from the participant index. Returned candidates
+// may be a superset of the matches, testFilter() is still to be
+// applied on the converted items.
+bool ItemCalendars::participantCandidates(const QOrganizerItemFilter &filter,
+                                          QSet<QString> *candidates) const
+{
+    switch (filter.type()) {
+    case QOrganizerItemFilter::DetailFieldFilter: {
+        const QOrganizerItemDetailFieldFilter fieldFilter(filter);
+        const QHash<QString, QSet<QString>> *index = nullptr;
+        if (fieldFilter.detailType() == QOrganizerItemDetail::TypeEventAttendee
+            && fieldFilter.detailField() == QOrganizerEventAttendee::FieldEmailAddress) {
+            index = &mAttendeeIndex;
+        } else if (fieldFilter.detailType() == QOrganizerItemDetail::TypeEventRsvp
+                   && fieldFilter.detailField() == QOrganizerEventRsvp::FieldOrganizerEmail) {
+            index = &mOrganizerIndex;
+        }
+        // Only exact matches can be answered by the index.
+        if (!index
+            || fieldFilter.value().type() != QVariant::String
+            || (fieldFilter.matchFlags() & (QOrganizerItemFilter::MatchContains
+                                            | QOrganizerItemFilter::MatchStartsWith
+                                            | QOrganizerItemFilter::MatchEndsWith
+                                            | QOrganizerItemFilter::MatchKeypadCollation))) {
+            return false;
+        }
+        *candidates = index->value(fieldFilter.value().toString().toLower());
+        return true;
+    }
+    case QOrganizerItemFilter::IntersectionFilter: {
+        bool restricted = false;
+        for (const QOrganizerItemFilter &sub : QOrganizerItemIntersectionFilter(filter).filters()) {
+            QSet<QString> subset;
+            if (participantCandidates(sub, &subset)) {
+                if (restricted) {
+                    candidates->intersect(subset);
+                } else {
+                    *candidates = subset;
+                }
+                restricted = true;
+            }
+        }
+        return restricted;
+    }
+    case QOrganizerItemFilter::UnionFilter: {
+        const QList<QOrganizerItemFilter> filters = QOrganizerItemUnionFilter(filter).filters();
+        if (filters.isEmpty()) {
+            return false;
+        }
+        candidates->clear();
+        for (const QOrganizerItemFilter &sub : filters) {
+            QSet<QString> subset;
+            if (!participantCandidates(sub, &subset)) {
+                return false;
+            }
+            candidates->unite(subset);
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+QOrganizerItem ItemCalendars::toItem(const QString &managerUri,
+                                     const KCalendarCore::Incidence::Ptr &incidence,
+                                     const QString &notebookUid,
+                                     const QList<QOrganizerItemDetail::DetailType> &details)
+{
+    QOrganizerItem item;
+
+    item.setId(QOrganizerItemId(managerUri,
+                                incidence->instanceIdentifier().toUtf8()));
+    item.setCollectionId(QOrganizerCollectionId(managerUri,
+                                                notebookUid.toUtf8()));
+    switch (incidence->type()) {
+    case KCalendarCore::Incidence::TypeEvent:
+        toItemEvent(&item, incidence.staticCast<KCalendarCore::Event>(), details);
+        break;
+    case KCalendarCore::Incidence::TypeTodo:
+        toItemTodo(&item, incidence.staticCast<KCalendarCore::Todo>(), details);
+        break;
+    case KCalendarCore::Incidence::TypeJournal:
+        toItemJournal(&item, incidence.staticCast<KCalendarCore::Journal>(), details);
+        break;
+    default:
+        break;
+    }
+
+    return item;
+}
+
+// A tombstone only carries the identifiers and type of a deleted
+// incidence, with an extended "deleted" detail storing the deletion date.
+QOrganizerItem ItemCalendars::toDeletedItem(const QString &managerUri,
+                                            const KCalendarCore::Incidence::Ptr &incidence,
+                                            const QString &notebookUid,
+                                            const QDateTime &deletionDate)
 {
     QOrganizerItem item;
 
+    item.setId(QOrganizerItemId(managerUri,
+                                incidence->instanceIdentifier().toUtf8()));
+    item.setCollectionId(QOrganizerCollectionId(managerUri,
+                                                notebookUid.toUtf8()));
+    switch (incidence->type()) {
+    case KCalendarCore::Incidence::TypeEvent:
+        item.setType(incidence->hasRecurrenceId()
+                     ? QOrganizerItemType::TypeEventOccurrence
+                     : QOrganizerItemType::TypeEvent);
+        break;
+    case KCalendarCore::Incidence::TypeTodo:
+        item.setType(incidence->hasRecurrenceId()
+                     ? QOrganizerItemType::TypeTodoOccurrence
+                     : QOrganizerItemType::TypeTodo);
+        break;
+    case KCalendarCore::Incidence::TypeJournal:
+        item.setType(QOrganizerItemType::TypeJournal);
+        break;
+    default:
+        break;
+    }
+    QOrganizerItemTimestamp stamp;
+    stamp.setCreated(incidence->created());
+    stamp.setLastModified(deletionDate);
+    item.saveDetail(&stamp);
+    QOrganizerItemExtendedDetail deleted;
+    deleted.setName(QStringLiteral("deleted"));
+    deleted.setData(deletionDate);
+    item.saveDetail(&deleted);
+
+    return item;
+}
+
+QOrganizerItem ItemCalendars::item(const QOrganizerItemId &id,
+                                   const QList<QOrganizerItemDetail::DetailType> &details) const
+{
     KCalendarCore::Incidence::Ptr incidence = instance(id.localId());
     if (incidence) {
-        item.setId(id);
-        item.setCollectionId(QOrganizerCollectionId(id.managerUri(),
-                                                    notebook(incidence).toUtf8()));
-        switch (incidence->type()) {
-        case KCalendarCore::Incidence::TypeEvent:
-            toItemEvent(&item, incidence.staticCast<KCalendarCore::Event>(), details);
-            break;
-        case KCalendarCore::Incidence::TypeTodo:
-            toItemTodo(&item, incidence.staticCast<KCalendarCore::Todo>(), details);
-            break;
-        case KCalendarCore::Incidence::TypeJournal:
-            toItemJournal(&item, incidence.staticCast<KCalendarCore::Journal>(), details);
-            break;
-        default:
-            break;
-        }
+        return toItem(id.managerUri(), incidence, notebook(incidence), details);
     }
 
+    return QOrganizerItem();
+}
+
+static QOrganizerItem occurrenceItem(const QString &managerUri,
+                                     const KCalendarCore::OccurrenceIterator &it,
+                                     const QByteArray &notebookUid,
+                                     const QList<QOrganizerItemDetail::DetailType> &details)
+{
+    const KCalendarCore::Incidence::Ptr incidence = it.incidence();
+    QOrganizerItem item;
+    if (!it.recurrenceId().isValid() || incidence->hasRecurrenceId()) {
+        // A "real" occurrence, either a non-recurring incidence or an exception.
+        item.setId(QOrganizerItemId(managerUri,
+                                    incidence->instanceIdentifier().toUtf8()));
+    }
+    item.setCollectionId(QOrganizerCollectionId(managerUri, notebookUid));
+    switch (incidence->type()) {
+    case KCalendarCore::Incidence::TypeEvent:
+        toItemEvent(&item, incidence.staticCast<KCalendarCore::Event>(), details,
+                    it.occurrenceStartDate(), it.occurrenceEndDate(), it.recurrenceId());
+        break;
+    case KCalendarCore::Incidence::TypeTodo:
+        toItemTodo(&item, incidence.staticCast<KCalendarCore::Todo>(), details,
+                   it.occurrenceStartDate(), it.occurrenceEndDate(), it.recurrenceId());
+        break;
+    case KCalendarCore::Incidence::TypeJournal:
+        toItemJournal(&item, incidence.staticCast<KCalendarCore::Journal>(), details);
+        break;
+    default:
+        break;
+    }
     return item;
 }
 
+// Filters that can be evaluated on the incidence
+// directly, without converting it to an item.
+static bool isStructuralFilter(const QOrganizerItemFilter &filter)
+{
+    switch (filter.type()) {
+    case QOrganizerItemFilter::DefaultFilter:
+    case QOrganizerItemFilter::CollectionFilter:
+    case QOrganizerItemFilter::IdFilter:
+        return true;
+    case QOrganizerItemFilter::IntersectionFilter:
+        for (const QOrganizerItemFilter &f : QOrganizerItemIntersectionFilter(filter).filters()) {
+            if (!isStructuralFilter(f)) {
+                return false;
+            }
+        }
+        return true;
+    case QOrganizerItemFilter::UnionFilter:
+        for (const QOrganizerItemFilter &f : QOrganizerItemUnionFilter(filter).filters()) {
+            if (!isStructuralFilter(f)) {
+                return false;
+            }
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool testStructuralFilter(const QOrganizerItemFilter &filter,
+                                 const QByteArray &localId,
+                                 const QByteArray &notebookUid)
+{
+    switch (filter.type()) {
+    case QOrganizerItemFilter::DefaultFilter:
+        return true;
+    case QOrganizerItemFilter::CollectionFilter:
+        for (const QOrganizerCollectionId &id : QOrganizerItemCollectionFilter(filter).collectionIds()) {
+            if (id.localId() == notebookUid) {
+                return true;
+            }
+        }
+        return false;
+    case QOrganizerItemFilter::IdFilter:
+        for (const QOrganizerItemId &id : QOrganizerItemIdFilter(filter).ids()) {
+            if (!localId.isEmpty() && id.localId() == localId) {
+                return true;
+            }
+        }
+        return false;
+    case QOrganizerItemFilter::IntersectionFilter:
+        for (const QOrganizerItemFilter &f : QOrganizerItemIntersectionFilter(filter).filters()) {
+            if (!testStructuralFilter(f, localId, notebookUid)) {
+                return false;
+            }
+        }
+        return true;
+    case QOrganizerItemFilter::UnionFilter:
+        for (const QOrganizerItemFilter &f : QOrganizerItemUnionFilter(filter).filters()) {
+            if (testStructuralFilter(f, localId, notebookUid)) {
+                return true;
+            }
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+// Tell if the incidence, or one of its occurrences, happens within
+// the given window. Invalid bounds leave the window open.
+bool ItemCalendars::occursIn(const KCalendarCore::Incidence::Ptr &incidence,
+                             const QDateTime &startDateTime,
+                             const QDateTime &endDateTime) const
+{
+    if (!startDateTime.isValid() && !endDateTime.isValid()) {
+        return true;
+    }
+    KCalendarCore::OccurrenceIterator it(*this, incidence, startDateTime, endDateTime);
+    return it.hasNext();
+}
+
+KCalendarCore::Incidence::List ItemCalendars::matchingIncidences(const QString &managerUri,
+                                                                 const QOrganizerItemFilter &filter,
+                                                                 const QDateTime &startDateTime,
+                                                                 const QDateTime &endDateTime) const
+{
+    KCalendarCore::Incidence::List list;
+
+    QSet<QString> candidates;
+    const bool restricted = participantCandidates(filter, &candidates);
+    if (restricted && candidates.isEmpty()) {
+        return list;
+    }
+
+    const bool structural = isStructuralFilter(filter);
+    QSet<QString> found;
+    KCalendarCore::OccurrenceIterator it(*this, startDateTime, endDateTime);
+    while (it.hasNext()) {
+        it.next();
+        KCalendarCore::Incidence::Ptr incidence = it.incidence();
+        const QString identifier = incidence->instanceIdentifier();
+        if (found.contains(identifier)
+            || (restricted && !candidates.contains(identifier))) {
+            continue;
+        }
+        const QByteArray notebookUid = notebook(incidence).toUtf8();
+        bool match;
+        if (structural) {
+            // Generated occurrences have no id of their own.
+            const bool generated = it.recurrenceId().isValid()
+                && !incidence->hasRecurrenceId();
+            match = testStructuralFilter(filter,
+                                         generated ? QByteArray() : identifier.toUtf8(),
+                                         notebookUid);
+        } else {
+            match = QOrganizerManagerEngine::testFilter(filter,
+                                                        occurrenceItem(managerUri, it, notebookUid,
+                                                                       QList<QOrganizerItemDetail::DetailType>()));
+        }
+        // A matching occurrence stands for its whole series, like in itemIds().
+        if (match) {
+            list.append(incidence);
+            found.insert(identifier);
+        }
+    }
+
+    return list;
+}
+
 QList<QOrganizerItem> ItemCalendars::items(const QString &managerUri,
                                            const QOrganizerItemFilter &filter,
                                            const QDateTime &startDateTime,
@@ -775,12 +1323,25 @@ QList<QOrganizerItem> ItemCalendars::items(const QString &managerUri,
                                            const QList<QOrganizerItemDetail::DetailType> &details) const
 {
     QList<QOrganizerItem> items;
+    Tracer::Span span("items");
+    if (Tracer::isEnabled()) {
+        span.setArg(QStringLiteral("filter"), int(filter.type()));
+    }
+
+    QSet<QString> candidates;
+    const bool restricted = participantCandidates(filter, &candidates);
+    if (restricted && candidates.isEmpty()) {
+        return items;
+    }
 
     int count = 0;
     KCalendarCore::OccurrenceIterator it(*this, startDateTime, endDateTime);
     while (it.hasNext() && (count < maxCount || maxCount < 1)) {
         it.next();
         KCalendarCore::Incidence::Ptr incidence = it.incidence();
+        if (restricted && !candidates.contains(incidence->instanceIdentifier())) {
+            continue;
+        }
         const QByteArray notebookUid = notebook(incidence).toUtf8();
         if (filter.type() == QOrganizerItemFilter::CollectionFilter) {
             bool match = false;
@@ -794,33 +1355,15 @@ QList<QOrganizerItem> ItemCalendars::items(const QString &managerUri,
                 continue;
             }
         }
-        QOrganizerItem item;
-        if (!it.recurrenceId().isValid() || incidence->hasRecurrenceId()) {
-            // A "real" occurrence, either a non-recurring incidence or an exception.
-            item.setId(QOrganizerItemId(managerUri,
-                                        incidence->instanceIdentifier().toUtf8()));
-        }
-        item.setCollectionId(QOrganizerCollectionId(managerUri, notebookUid));
-        switch (incidence->type()) {
-        case KCalendarCore::Incidence::TypeEvent:
-            toItemEvent(&item, incidence.staticCast<KCalendarCore::Event>(), details,
-                        it.occurrenceStartDate(), it.occurrenceEndDate(), it.recurrenceId());
-            break;
-        case KCalendarCore::Incidence::TypeTodo:
-            toItemTodo(&item, incidence.staticCast<KCalendarCore::Todo>(), details,
-                       it.occurrenceStartDate(), it.occurrenceEndDate(), it.recurrenceId());
-            break;
-        case KCalendarCore::Incidence::TypeJournal:
-            toItemJournal(&item, incidence.staticCast<KCalendarCore::Journal>(), details);
-            break;
-        default:
-            break;
-        }
+        const QOrganizerItem item = occurrenceItem(managerUri, it, notebookUid, details);
         if (QOrganizerManagerEngine::testFilter(filter, item)) {
             items.append(item);
             count += 1;
         }
     }
+    if (Tracer::isEnabled()) {
+        span.setArg(QStringLiteral("items"), count);
+    }
 
     return items;
 }
@@ -872,17 +1415,45 @@ QList<QOrganizerItem> ItemCalendars::occurrences(const QString &managerUri,
     return items;
 }
 
-QByteArray ItemCalendars::addItem(const QOrganizerItem &item)
+// Create a detached incidence from an item that is not an occurrence.
+// It doesn't access the calendar, so it can be called from any thread.
+KCalendarCore::Incidence::Ptr ItemCalendars::newIncidence(const QOrganizerItem &item)
+{
+    KCalendarCore::Incidence::Ptr newIncidence;
+    switch (item.type()) {
+    case QOrganizerItemType::TypeEvent:
+        newIncidence = KCalendarCore::Incidence::Ptr(new KCalendarCore::Event);
+        updateEvent(newIncidence.staticCast<KCalendarCore::Event>(), item);
+        break;
+    case QOrganizerItemType::TypeTodo:
+        newIncidence = KCalendarCore::Incidence::Ptr(new KCalendarCore::Todo);
+        updateTodo(newIncidence.staticCast<KCalendarCore::Todo>(), item);
+        break;
+    case QOrganizerItemType::TypeJournal:
+        newIncidence = KCalendarCore::Incidence::Ptr(new KCalendarCore::Journal);
+        updateJournal(newIncidence.staticCast<KCalendarCore::Journal>(), item);
+        break;
+    default:
+        break;
+    }
+    return newIncidence;
+}
+
+QByteArray ItemCalendars::addItem(const QOrganizerItem &item,
+                                  const KCalendarCore::Incidence::Ptr &prepared)
 {
     if (item.collectionId().isNull()) {
         return QByteArray();
     }
 
-    KCalendarCore::Incidence::Ptr newIncidence;
+    KCalendarCore::Incidence::Ptr newIncidence = prepared;
     switch (item.type()) {
     case QOrganizerItemType::TypeEvent:
-        newIncidence = KCalendarCore::Incidence::Ptr(new KCalendarCore::Event);
-        updateEvent(newIncidence.staticCast<KCalendarCore::Event>(), item);
+    case QOrganizerItemType::TypeTodo:
+    case QOrganizerItemType::TypeJournal:
+        if (!newIncidence) {
+            newIncidence = ItemCalendars::newIncidence(item);
+        }
         break;
     case QOrganizerItemType::TypeEventOccurrence: {
         const QOrganizerItemParent detail(item.detail(QOrganizerItemDetail::TypeParent));
@@ -896,10 +1467,6 @@ QByteArray ItemCalendars::addItem(const QOrganizerItem &item)
         }
         break;
     }
-    case QOrganizerItemType::TypeTodo:
-        newIncidence = KCalendarCore::Incidence::Ptr(new KCalendarCore::Todo);
-        updateTodo(newIncidence.staticCast<KCalendarCore::Todo>(), item);
-        break;
     case QOrganizerItemType::TypeTodoOccurrence: {
         const QOrganizerItemParent detail(item.detail(QOrganizerItemDetail::TypeParent));
         const QString uid = QString::fromUtf8(detail.parentId().localId());
@@ -912,10 +1479,6 @@ QByteArray ItemCalendars::addItem(const QOrganizerItem &item)
         }
         break;
     }
-    case QOrganizerItemType::TypeJournal:
-        newIncidence = KCalendarCore::Incidence::Ptr(new KCalendarCore::Journal);
-        updateJournal(newIncidence.staticCast<KCalendarCore::Journal>(), item);
-        break;
     default:
         break;
     }
@@ -927,16 +1490,81 @@ QByteArray ItemCalendars::addItem(const QOrganizerItem &item)
     return QByteArray();
 }
 
+// Return the detail types changed by updateItem() since the last call,
+// an empty list meaning that any detail may have changed.
+QList<QOrganizerItemDetail::DetailType> ItemCalendars::takeChangedDetails(const QString &instanceIdentifier)
+{
+    const QSet<QOrganizerItemDetail::DetailType> changes = mChangedDetails.take(instanceIdentifier);
+    if (changes.contains(QOrganizerItemDetail::TypeUndefined)) {
+        return QList<QOrganizerItemDetail::DetailType>();
+    }
+    QList<QOrganizerItemDetail::DetailType> details = changes.toList();
+    std::sort(details.begin(), details.end());
+    return details;
+}
+
+// Reassign an incidence to another notebook, keeping its uid.
+// Exceptions cannot live apart from their parent, the whole
+// series is moved.
+bool ItemCalendars::moveIncidence(const KCalendarCore::Incidence::Ptr &target,
+                                  const QString &notebookUid)
+{
+    const KCalendarCore::Incidence::Ptr parent = target->hasRecurrenceId()
+        ? incidence(target->uid()) : target;
+    if (!parent) {
+        return false;
+    }
+    if (notebook(parent) == notebookUid) {
+        return true;
+    }
+
+    KCalendarCore::Incidence::List series = instances(parent);
+    series.prepend(parent);
+    for (const KCalendarCore::Incidence::Ptr &incidence : series) {
+        if (!setNotebook(incidence, notebookUid)) {
+            return false;
+        }
+        // The notebook is not an incidence property,
+        // notify the storage explicitly.
+        incidence->update();
+        incidence->updated();
+        // Not a detail change, clients should refetch the whole item.
+        mChangedDetails[incidence->instanceIdentifier()].insert(QOrganizerItemDetail::TypeUndefined);
+    }
+    return true;
+}
+
+// Drop incidences from memory only, the storage observer must be
+// unregistered by the caller so they stay untouched in the database.
+// Exceptions go first, they cannot outlive their parent.
+void ItemCalendars::unload(const KCalendarCore::Incidence::List &incidences)
+{
+    const bool tracking = deletionTracking();
+    setDeletionTracking(false);
+    for (const KCalendarCore::Incidence::Ptr &incidence : incidences) {
+        if (incidence->hasRecurrenceId()) {
+            deleteIncidence(incidence);
+        }
+    }
+    for (const KCalendarCore::Incidence::Ptr &incidence : incidences) {
+        if (!incidence->hasRecurrenceId()) {
+            deleteIncidence(incidence);
+        }
+    }
+    setDeletionTracking(tracking);
+}
+
 bool ItemCalendars::updateItem(const QOrganizerItem &item,
                                const QList<QOrganizerItemDetail::DetailType> &detailMask)
 {
+    QSet<QOrganizerItemDetail::DetailType> changes;
     KCalendarCore::Incidence::Ptr incidence;
     switch (item.type()) {
     case QOrganizerItemType::TypeEventOccurrence:
     case QOrganizerItemType::TypeEvent:
         incidence = instance(item.id().localId());
         if (incidence && incidence->type() == KCalendarCore::Incidence::TypeEvent) {
-            updateEvent(incidence.staticCast<KCalendarCore::Event>(), item, detailMask);
+            updateEvent(incidence.staticCast<KCalendarCore::Event>(), item, detailMask, &changes);
         } else {
             incidence.clear();
         }
@@ -945,7 +1573,7 @@ bool ItemCalendars::updateItem(const QOrganizerItem &item,
     case QOrganizerItemType::TypeTodo:
         incidence = instance(item.id().localId());
         if (incidence && incidence->type() == KCalendarCore::Incidence::TypeTodo) {
-            updateTodo(incidence.staticCast<KCalendarCore::Todo>(), item, detailMask);
+            updateTodo(incidence.staticCast<KCalendarCore::Todo>(), item, detailMask, &changes);
         } else {
             incidence.clear();
         }
@@ -953,12 +1581,20 @@ bool ItemCalendars::updateItem(const QOrganizerItem &item,
     case QOrganizerItemType::TypeJournal:
         incidence = journal(item.id().localId());
         if (incidence) {
-            updateJournal(incidence.staticCast<KCalendarCore::Journal>(), item, detailMask);
+            updateJournal(incidence.staticCast<KCalendarCore::Journal>(), item, detailMask, &changes);
         }
         break;
     default:
         break;
     }
+    if (incidence && !changes.isEmpty()) {
+        mChangedDetails[incidence->instanceIdentifier()].unite(changes);
+    }
+    if (incidence && !item.collectionId().isNull()
+        && notebook(incidence).toUtf8() != item.collectionId().localId()
+        && !moveIncidence(incidence, QString::fromUtf8(item.collectionId().localId()))) {
+        return false;
+    }
     return !incidence.isNull();
 }
 
@@ -34,14 +34,28 @@
 
 #include <extendedcalendar.h>
 
+#include <QHash>
+#include <QSet>
+
 #include <QtOrganizer/QOrganizerItem>
 #include <QtOrganizer/QOrganizerItemFilter>
 #include <QtOrganizer/QOrganizerItemDetail>
 
-class ItemCalendars: public mKCal::ExtendedCalendar
+class ItemCalendars: public mKCal::ExtendedCalendar,
+                     public KCalendarCore::Calendar::CalendarObserver
 {
 public:
     ItemCalendars(const QTimeZone &timezone);
+    ~ItemCalendars();
+
+    static QtOrganizer::QOrganizerItem toItem(const QString &managerUri,
+                                              const KCalendarCore::Incidence::Ptr &incidence,
+                                              const QString &notebookUid,
+                                              const QList<QtOrganizer::QOrganizerItemDetail::DetailType> &details = QList<QtOrganizer::QOrganizerItemDetail::DetailType>());
+    static QtOrganizer::QOrganizerItem toDeletedItem(const QString &managerUri,
+                                                     const KCalendarCore::Incidence::Ptr &incidence,
+                                                     const QString &notebookUid,
+                                                     const QDateTime &deletionDate);
 
     QtOrganizer::QOrganizerItem item(const QtOrganizer::QOrganizerItemId &id,
                                      const QList<QtOrganizer::QOrganizerItemDetail::DetailType> &details = QList<QtOrganizer::QOrganizerItemDetail::DetailType>()) const;
@@ -51,6 +65,14 @@ public:
                                              const QDateTime &endDateTime,
                                              int maxCount,
                                              const QList<QtOrganizer::QOrganizerItemDetail::DetailType> &details) const;
+    bool occursIn(const KCalendarCore::Incidence::Ptr &incidence,
+                  const QDateTime &startDateTime,
+                  const QDateTime &endDateTime) const;
+    KCalendarCore::Incidence::List
+        matchingIncidences(const QString &managerUri,
+                           const QtOrganizer::QOrganizerItemFilter &filter,
+                           const QDateTime &startDateTime,
+                           const QDateTime &endDateTime) const;
     QList<QtOrganizer::QOrganizerItem> occurrences(const QString &managerUri,
                                                    const QtOrganizer::QOrganizerItem &parentItem,
                                                    const QDateTime &startDateTime,
@@ -58,10 +80,41 @@ public:
                                                    int maxCount,
                                                    const QList<QtOrganizer::QOrganizerItemDetail::DetailType> &details) const;
     
-    QByteArray addItem(const QtOrganizer::QOrganizerItem &item);
+    static KCalendarCore::Incidence::Ptr newIncidence(const QtOrganizer::QOrganizerItem &item);
+    QByteArray addItem(const QtOrganizer::QOrganizerItem &item,
+                       const KCalendarCore::Incidence::Ptr &prepared = KCalendarCore::Incidence::Ptr());
     bool updateItem(const QtOrganizer::QOrganizerItem &item,
                     const QList<QtOrganizer::QOrganizerItemDetail::DetailType> &detailMask = QList<QtOrganizer::QOrganizerItemDetail::DetailType>());
     bool removeItem(const QtOrganizer::QOrganizerItem &item);
+    QList<QtOrganizer::QOrganizerItemDetail::DetailType> takeChangedDetails(const QString &instanceIdentifier);
+    bool moveIncidence(const KCalendarCore::Incidence::Ptr &target,
+                       const QString &notebookUid);
+    void unload(const KCalendarCore::Incidence::List &incidences);
+    int indexEntryCount() const;
+
+private:
+    // Participant index, kept in sync with the calendar content
+    // through the observer interface, so incidences added by
+    // saveItems(), removed by removeItems() or loaded from storage
+    // are all tracked.
+    void calendarIncidenceAdded(const KCalendarCore::Incidence::Ptr &incidence) override;
+    void calendarIncidenceChanged(const KCalendarCore::Incidence::Ptr &incidence) override;
+    void calendarIncidenceDeleted(const KCalendarCore::Incidence::Ptr &incidence,
+                                  const KCalendarCore::Calendar *calendar) override;
+
+    void indexIncidence(const KCalendarCore::Incidence::Ptr &incidence);
+    void unindexIncidence(const QString &instanceIdentifier);
+    bool participantCandidates(const QtOrganizer::QOrganizerItemFilter &filter,
+                               QSet<QString> *candidates) const;
+
+    QHash<QString, QSet<QString>> mAttendeeIndex;
+    QHash<QString, QSet<QString>> mOrganizerIndex;
+    QHash<QString, QStringList> mIndexedAttendees;
+    QHash<QString, QString> mIndexedOrganizers;
+
+    // Detail types modified by updateItem() per instance,
+    // until reported by the storage update notification.
+    QHash<QString, QSet<QtOrganizer::QOrganizerItemDetail::DetailType>> mChangedDetails;
 };
 
 #endif
@@ -45,6 +45,11 @@
 #include <QElapsedTimer>
 #include <QTimer>
 #include <QEventLoop>
+#include <QMutex>
+#include <QHash>
+#include <QIODevice>
+
+#include "tracer.h"
 
 using namespace QtOrganizer;
 
@@ -53,9 +58,35 @@ QOrganizerManagerEngine* mKCalFactory::engine(const QMap<QString, QString>& para
     Q_UNUSED(error);
     QString tzname = parameters.value(QStringLiteral("timeZone"));
     QString dbname = parameters.value(QStringLiteral("databaseName"));
-
-    mKCalEngine *engine = new mKCalEngine(QTimeZone(tzname.toUtf8()), dbname);
-    if (!engine->isOpened())
+    mKCalOptions options;
+    const QString writeBehind = parameters.value(QStringLiteral("writeBehind"));
+    options.writeBehind = (writeBehind == QStringLiteral("true")
+                           || writeBehind == QStringLiteral("1"));
+    bool ok;
+    const int interval = parameters.value(QStringLiteral("flushInterval")).toInt(&ok);
+    if (ok && interval >= 0) {
+        options.flushInterval = interval;
+    }
+    const int window = parameters.value(QStringLiteral("notificationWindow")).toInt(&ok);
+    if (ok && window >= 0) {
+        options.notificationWindow = window;
+    }
+    const int reportInterval = parameters.value(QStringLiteral("memoryReportInterval")).toInt(&ok);
+    if (ok && reportInterval >= 0) {
+        options.memoryReportInterval = reportInterval;
+    }
+    const int threshold = parameters.value(QStringLiteral("slowRequestThreshold")).toInt(&ok);
+    if (ok && threshold >= 0) {
+        options.slowRequestThreshold = threshold;
+    }
+    const QString asyncOpen = parameters.value(QStringLiteral("asyncOpen"));
+    options.asyncOpen = (asyncOpen == QStringLiteral("true")
+                         || asyncOpen == QStringLiteral("1"));
+    options.traceFile = parameters.value(QStringLiteral("traceFile"),
+                                         QString::fromLocal8Bit(qgetenv("QTORGANIZER_MKCAL_TRACE")));
+
+    mKCalEngine *engine = new mKCalEngine(QTimeZone(tzname.toUtf8()), dbname, options);
+    if (!options.asyncOpen && !engine->isOpened())
         *error = QOrganizerManager::PermissionsError;
     return engine; // manager takes ownership and will clean up.
 }
@@ -65,59 +96,104 @@ QString mKCalFactory::managerName() const
     return QStringLiteral("mkcal");
 }
 
+static QMutex sharedWorkersMutex;
+static QHash<QString, QWeakPointer<SharedWorker>> sharedWorkers;
+
+// Engines with different options cannot share a worker,
+// asyncOpen and the trace file don't apply to it.
+static QString sharedWorkerKey(const QTimeZone &timeZone,
+                               const QString &databaseName,
+                               const mKCalOptions &options)
+{
+    return QStringLiteral("%1|%2|%3|%4|%5|%6|%7")
+        .arg(databaseName, QString::fromUtf8(timeZone.id()))
+        .arg(options.writeBehind).arg(options.flushInterval)
+        .arg(options.notificationWindow).arg(options.memoryReportInterval)
+        .arg(options.slowRequestThreshold);
+}
+
+SharedWorker::SharedWorker(const QString &key)
+    : mKey(key)
+    , mWorker(new mKCalWorker)
+{
+    mWorker->moveToThread(&mThread);
+    QObject::connect(&mThread, &QThread::finished,
+                     mWorker, &QObject::deleteLater);
+    mThread.setObjectName("mKCal worker");
+    mThread.start();
+}
+
+SharedWorker::~SharedWorker()
+{
+    mThread.quit();
+    mThread.wait();
+
+    // Unless already replaced by a new worker.
+    QMutexLocker lock(&sharedWorkersMutex);
+    QHash<QString, QWeakPointer<SharedWorker>>::Iterator it = sharedWorkers.find(mKey);
+    if (it != sharedWorkers.end() && it->isNull()) {
+        sharedWorkers.erase(it);
+    }
+}
+
+QSharedPointer<SharedWorker> SharedWorker::acquire(const QTimeZone &timeZone,
+                                                   const QString &databaseName,
+                                                   const mKCalOptions &options)
+{
+    const QString key = sharedWorkerKey(timeZone, databaseName, options);
+    QMutexLocker lock(&sharedWorkersMutex);
+    QSharedPointer<SharedWorker> shared = sharedWorkers.value(key).toStrongRef();
+    if (!shared) {
+        shared = QSharedPointer<SharedWorker>(new SharedWorker(key));
+        sharedWorkers.insert(key, shared);
+    }
+    return shared;
+}
+
+mKCalWorker *SharedWorker::worker() const
+{
+    return mWorker;
+}
+
 Q_DECLARE_METATYPE(QTimeZone)
 mKCalEngine::mKCalEngine(const QTimeZone &timeZone, const QString &databaseName,
-                         QObject *parent)
+                         const mKCalOptions &options, QObject *parent)
     : QOrganizerManagerEngine(parent)
 {
+    if (!options.traceFile.isEmpty()) {
+        Tracer::open(options.traceFile);
+    }
+
     qRegisterMetaType<QOrganizerAbstractRequest*>();
+    qRegisterMetaType<QOrganizerItemFilter>();
+    qRegisterMetaType<QList<QOrganizerItemId>>();
+    qRegisterMetaType<ChangeLog::Feed>();
+    qRegisterMetaType<ItemSubscription>();
+    qRegisterMetaType<MemoryReport>();
+    qRegisterMetaType<ImportResult>();
 
-    mWorker = new mKCalWorker;
-    mWorker->moveToThread(&mWorkerThread);
-    connect(&mWorkerThread, &QThread::finished,
-            mWorker, &QObject::deleteLater);
+    mSharedWorker = SharedWorker::acquire(timeZone, databaseName, options);
+    mWorker = mSharedWorker->worker();
 
     connect(mWorker, &mKCalWorker::dataChanged,
             this, &mKCalEngine::dataChanged);
+    qRegisterMetaType<ItemChangeSetPtr>();
     connect(mWorker, &mKCalWorker::itemsUpdated,
-            this, [this] (const QStringList &added,
-                          const QStringList &modified,
-                          const QStringList &deleted) {
-                      QList<QOrganizerItemId> ids;
-                      QList<QPair<QOrganizerItemId, QOrganizerManager::Operation>> ops;
-
-                      ids.clear();
-                      for (const QString &uid : added) {
-                          const QOrganizerItemId id = itemId(uid.toUtf8());
-                          ids << id;
-                          ops << QPair<QOrganizerItemId, QOrganizerManager::Operation>(id, QOrganizerManager::Add);
-                      }
-                      if (!ids.isEmpty()) {
-                          emit itemsAdded(ids);
-                      }
-
-                      ids.clear();
-                      for (const QString &uid : modified) {
-                          const QOrganizerItemId id = itemId(uid.toUtf8());
-                          ids << id;
-                          ops << QPair<QOrganizerItemId, QOrganizerManager::Operation>(id, QOrganizerManager::Change);
+            this, [this] (const ItemChangeSetPtr &changes) {
+                      if (!changes->clients.contains(this)) {
+                          return;
                       }
-                      if (!ids.isEmpty()) {
-                          emit itemsChanged(ids, QList<QOrganizerItemDetail::DetailType>());
+                      if (!changes->added.isEmpty()) {
+                          emit itemsAdded(changes->added);
                       }
-
-                      ids.clear();
-                      for (const QString &uid : deleted) {
-                          const QOrganizerItemId id = itemId(uid.toUtf8());
-                          ids << id;
-                          ops << QPair<QOrganizerItemId, QOrganizerManager::Operation>(id, QOrganizerManager::Remove);
+                      for (const ItemChangeSet::DetailChanges &group : changes->changedDetails) {
+                          emit itemsChanged(group.first, group.second);
                       }
-                      if (!ids.isEmpty()) {
-                          emit itemsRemoved(ids);
+                      if (!changes->removed.isEmpty()) {
+                          emit itemsRemoved(changes->removed);
                       }
-
-                      if (!ops.isEmpty()) {
-                          emit itemsModified(ops);
+                      if (!changes->operations.isEmpty()) {
+                          emit itemsModified(changes->operations);
                       }
                   });
     connect(mWorker, &mKCalWorker::collectionsUpdated,
@@ -161,6 +237,16 @@ mKCalEngine::mKCalEngine(const QTimeZone &timeZone, const QString &databaseName,
                           emit collectionsModified(ops);
                       }
                   });
+    qRegisterMetaType<QList<QOrganizerCollection>>();
+    connect(mWorker, &mKCalWorker::collectionsRefreshed,
+            this, &mKCalEngine::setCollections);
+    connect(mWorker, &mKCalWorker::collectionStatisticsChanged,
+            this, &mKCalEngine::updateCollections);
+    connect(mWorker, &mKCalWorker::collectionRemovalProgress,
+            this, [this] (const QString &uid, int removed, int total) {
+                      emit collectionRemovalProgress(collectionId(uid.toUtf8()),
+                                                     removed, total);
+                  });
     connect(mWorker, &mKCalWorker::defaultCollectionIdChanged,
             this, [this] (const QString &id) {
                       if (id.toUtf8() != mDefaultCollectionId.localId()) {
@@ -168,33 +254,102 @@ mKCalEngine::mKCalEngine(const QTimeZone &timeZone, const QString &databaseName,
                       }
                   });
 
-    mWorkerThread.setObjectName("mKCal worker");
-    mWorkerThread.start();
+    connect(mWorker, &mKCalWorker::initialised,
+            this, &mKCalEngine::setInitialised);
 
     qRegisterMetaType<QTimeZone>();
-    QMetaObject::invokeMethod(mWorker, "init", Qt::BlockingQueuedConnection,
-                              Q_RETURN_ARG(bool, mOpened),
-                              Q_ARG(QTimeZone, timeZone),
-                              Q_ARG(QString, databaseName));
+    qRegisterMetaType<mKCalOptions>();
     mParameters.insert(QStringLiteral("timeZone"),
                        QString::fromUtf8(timeZone.id()));
     mParameters.insert(QStringLiteral("databaseName"), databaseName);
+    if (options.asyncOpen) {
+        // The collections and the default collection id are
+        // notified by the worker before it reports being ready.
+        QMetaObject::invokeMethod(mWorker, "init", Qt::QueuedConnection,
+                                  Q_ARG(QTimeZone, timeZone),
+                                  Q_ARG(QString, databaseName),
+                                  Q_ARG(mKCalOptions, options),
+                                  Q_ARG(QObject*, this));
+        return;
+    }
+    QMetaObject::invokeMethod(mWorker, "init", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, mOpened),
+                              Q_ARG(QTimeZone, timeZone),
+                              Q_ARG(QString, databaseName),
+                              Q_ARG(mKCalOptions, options),
+                              Q_ARG(QObject*, this));
     QMetaObject::invokeMethod(mWorker, "defaultCollectionId",
                               Qt::BlockingQueuedConnection,
                               Q_RETURN_ARG(QtOrganizer::QOrganizerCollectionId, mDefaultCollectionId));
+    refreshCollections();
+    mReady = true;
+    // Failures are reported by the factory instead.
+    mReadyNotified = true;
 }
 
 mKCalEngine::~mKCalEngine()
 {
-    mWorkerThread.quit();
-    mWorkerThread.wait();
+    // The worker is deleted with its last engine.
+    QMetaObject::invokeMethod(mWorker, "detach", Qt::BlockingQueuedConnection,
+                              Q_ARG(QObject*, this));
 }
 
+// With asyncOpen, only meaningful once ready.
 bool mKCalEngine::isOpened() const
 {
     return mOpened;
 }
 
+bool mKCalEngine::isReady() const
+{
+    return mReady;
+}
+
+void mKCalEngine::setInitialised(bool opened)
+{
+    if (mReadyNotified) {
+        return;
+    }
+    mReadyNotified = true;
+    if (!mReady) {
+        mOpened = opened;
+        mReady = true;
+        if (!mRunningRequest) {
+            processRequests();
+        }
+    }
+    if (!mOpened) {
+        // Manager clients cannot connect to ready(), let them
+        // refetch and get the error from their next call.
+        qWarning("mKCal cannot open the database %s",
+                 qPrintable(mParameters.value(QStringLiteral("databaseName"))));
+        emit dataChanged();
+    }
+    emit ready(mOpened);
+}
+
+// Synchronous calls to the worker are run after its init,
+// so the calls reading the engine state only need a blocking
+// call to the worker. No event loop is run, the getters are
+// not re-entrant and ready() is still emitted later, from
+// the initialised() notification of the worker.
+void mKCalEngine::waitForReady()
+{
+    if (mReady) {
+        return;
+    }
+    QMetaObject::invokeMethod(mWorker, "isOpened", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, mOpened));
+    QMetaObject::invokeMethod(mWorker, "defaultCollectionId",
+                              Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(QtOrganizer::QOrganizerCollectionId, mDefaultCollectionId));
+    refreshCollections();
+    mReady = true;
+    if (!mRunningRequest) {
+        processRequests();
+    }
+}
+
 QString mKCalEngine::managerName() const
 {
     return QStringLiteral("mkcal");
@@ -387,32 +542,58 @@ bool mKCalEngine::removeItems(const QList<QOrganizerItem> *items,
 
 QOrganizerCollectionId mKCalEngine::defaultCollectionId() const
 {
+    const_cast<mKCalEngine*>(this)->waitForReady();
     return mDefaultCollectionId;
 }
 
 QOrganizerCollection mKCalEngine::collection(const QOrganizerCollectionId &collectionId,
                                              QOrganizerManager::Error *error) const
 {
-    QOrganizerCollectionFetchRequest request;
-    QMetaObject::invokeMethod(mWorker, "runRequest", Qt::BlockingQueuedConnection,
-                              Q_ARG(QtOrganizer::QOrganizerAbstractRequest*, &request));
-    *error = request.error();
-    for (const QOrganizerCollection &collection : request.collections()) {
-        if (collection.id() == collectionId) {
-            return collection;
-        }
-    }
-
-    return QOrganizerCollection();
+    const_cast<mKCalEngine*>(this)->waitForReady();
+    *error = mOpened ? QOrganizerManager::NoError : QOrganizerManager::PermissionsError;
+    QHash<QOrganizerCollectionId, int>::ConstIterator it = mCollectionIndex.constFind(collectionId);
+    return it != mCollectionIndex.constEnd() ? mCollections.at(it.value()) : QOrganizerCollection();
 }
 
 QList<QOrganizerCollection> mKCalEngine::collections(QOrganizerManager::Error *error) const
+{
+    const_cast<mKCalEngine*>(this)->waitForReady();
+    *error = mOpened ? QOrganizerManager::NoError : QOrganizerManager::PermissionsError;
+    return mCollections;
+}
+
+// Fetch the collections from the worker, only needed when the
+// cache must be current before the worker notification arrives.
+void mKCalEngine::refreshCollections()
 {
     QOrganizerCollectionFetchRequest request;
     QMetaObject::invokeMethod(mWorker, "runRequest", Qt::BlockingQueuedConnection,
                               Q_ARG(QtOrganizer::QOrganizerAbstractRequest*, &request));
-    *error = request.error();
-    return request.collections();
+    setCollections(request.collections());
+}
+
+void mKCalEngine::setCollections(const QList<QOrganizerCollection> &collections)
+{
+    mCollections = collections;
+    mCollectionIndex.clear();
+    for (int i = 0; i < mCollections.count(); i++) {
+        mCollectionIndex.insert(mCollections.at(i).id(), i);
+    }
+}
+
+// Replace the given collections only, keeping the others.
+void mKCalEngine::updateCollections(const QList<QOrganizerCollection> &collections)
+{
+    for (const QOrganizerCollection &collection : collections) {
+        QHash<QOrganizerCollectionId, int>::ConstIterator it
+            = mCollectionIndex.constFind(collection.id());
+        if (it != mCollectionIndex.constEnd()) {
+            mCollections[it.value()] = collection;
+        } else {
+            mCollectionIndex.insert(collection.id(), mCollections.count());
+            mCollections.append(collection);
+        }
+    }
 }
 
 bool mKCalEngine::saveCollection(QOrganizerCollection *collection,
@@ -424,6 +605,7 @@ bool mKCalEngine::saveCollection(QOrganizerCollection *collection,
                               Q_ARG(QtOrganizer::QOrganizerAbstractRequest*, &request));
     *error = request.error();
     *collection = request.collections().first();
+    refreshCollections();
     return (*error == QOrganizerManager::NoError);
 }
 
@@ -435,9 +617,110 @@ bool mKCalEngine::removeCollection(const QOrganizerCollectionId &collectionId,
     QMetaObject::invokeMethod(mWorker, "runRequest", Qt::BlockingQueuedConnection,
                               Q_ARG(QtOrganizer::QOrganizerAbstractRequest*, &request));
     *error = request.error();
+    refreshCollections();
     return (*error == QOrganizerManager::NoError);
 }
 
+int mKCalEngine::importItems(QIODevice *device,
+                             const QOrganizerCollectionId &collectionId,
+                             QOrganizerManager::Error *error,
+                             int commitSize)
+{
+    waitForReady();
+    const QOrganizerCollectionId target = collectionId.isNull()
+        ? mDefaultCollectionId : collectionId;
+    ImportResult result;
+    QMetaObject::invokeMethod(mWorker, "importIcs", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(ImportResult, result),
+                              Q_ARG(QIODevice*, device),
+                              Q_ARG(QString, QString::fromUtf8(target.localId())),
+                              Q_ARG(int, commitSize));
+    // On a partial import, the already committed
+    // items are still counted.
+    *error = result.complete ? QOrganizerManager::NoError : QOrganizerManager::BadArgumentError;
+    return result.count;
+}
+
+ChangeLog::Feed mKCalEngine::changesSince(qint64 sequence,
+                                          QOrganizerManager::Error *error)
+{
+    waitForReady();
+    ChangeLog::Feed feed;
+    QMetaObject::invokeMethod(mWorker, "changesSince", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(ChangeLog::Feed, feed),
+                              Q_ARG(qint64, sequence));
+    *error = mOpened ? QOrganizerManager::NoError : QOrganizerManager::PermissionsError;
+    return feed;
+}
+
+MemoryReport mKCalEngine::memoryReport(QOrganizerManager::Error *error) const
+{
+    const_cast<mKCalEngine*>(this)->waitForReady();
+    MemoryReport report;
+    QMetaObject::invokeMethod(mWorker, "memoryReport", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(MemoryReport, report));
+    *error = mOpened ? QOrganizerManager::NoError : QOrganizerManager::PermissionsError;
+    return report;
+}
+
+int mKCalEngine::moveItems(const QList<QOrganizerItemId> &itemIds,
+                           const QOrganizerCollectionId &collectionId,
+                           QOrganizerManager::Error *error)
+{
+    int count = -1;
+    QMetaObject::invokeMethod(mWorker, "moveItems", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(int, count),
+                              Q_ARG(QList<QtOrganizer::QOrganizerItemId>, itemIds),
+                              Q_ARG(QString, QString::fromUtf8(collectionId.localId())));
+    *error = count < 0 ? QOrganizerManager::BadArgumentError : QOrganizerManager::NoError;
+    return count;
+}
+
+// Restrict the item change notifications to the items of the given
+// collections and types, occurring in the given window. Returns an
+// id to cancel the subscription with unsubscribe().
+int mKCalEngine::subscribe(const QList<QOrganizerCollectionId> &collectionIds,
+                           const QDateTime &startDateTime,
+                           const QDateTime &endDateTime,
+                           const QList<QOrganizerItemType::ItemType> &itemTypes,
+                           QOrganizerManager::Error *error)
+{
+    ItemSubscription subscription;
+    subscription.collectionIds = collectionIds;
+    subscription.startDateTime = startDateTime;
+    subscription.endDateTime = endDateTime;
+    subscription.itemTypes = itemTypes;
+    subscription.client = this;
+
+    int id = 0;
+    QMetaObject::invokeMethod(mWorker, "subscribe", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(int, id),
+                              Q_ARG(ItemSubscription, subscription));
+    *error = QOrganizerManager::NoError;
+    return id;
+}
+
+void mKCalEngine::unsubscribe(int subscriptionId)
+{
+    QMetaObject::invokeMethod(mWorker, "unsubscribe", Qt::BlockingQueuedConnection,
+                              Q_ARG(int, subscriptionId));
+}
+
+int mKCalEngine::removeMatchingItems(const QOrganizerItemFilter &filter,
+                                     const QDateTime &startDateTime,
+                                     const QDateTime &endDateTime,
+                                     QOrganizerManager::Error *error)
+{
+    int count = -1;
+    QMetaObject::invokeMethod(mWorker, "removeMatchingItems", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(int, count),
+                              Q_ARG(QtOrganizer::QOrganizerItemFilter, filter),
+                              Q_ARG(QDateTime, startDateTime),
+                              Q_ARG(QDateTime, endDateTime));
+    *error = count < 0 ? QOrganizerManager::PermissionsError : QOrganizerManager::NoError;
+    return count;
+}
+
 bool mKCalEngine::waitForCurrentRequestFinished(int msecs)
 {
     if (!mRunningRequest) {
@@ -467,6 +750,7 @@ void mKCalEngine::processRequests()
     }
     if (!mRequests.isEmpty()) {
         QOrganizerAbstractRequest *request = mRequests.dequeue();
+        Tracer::asyncEnd("queued", request);
         mRunningRequest = request;
         connect(mRunningRequest, &QOrganizerAbstractRequest::resultsAvailable,
                 this, &mKCalEngine::processRequests);
@@ -491,8 +775,13 @@ bool mKCalEngine::startRequest(QOrganizerAbstractRequest *request)
         return false;
     }
     updateRequestState(request, QOrganizerAbstractRequest::ActiveState);
+    if (Tracer::isEnabled()) {
+        QJsonObject args;
+        args.insert(QStringLiteral("type"), int(request->type()));
+        Tracer::asyncBegin("queued", request, args);
+    }
     mRequests.enqueue(request);
-    if (!mRunningRequest) {
+    if (mReady && !mRunningRequest) {
         processRequests();
     }
     return true;
@@ -501,6 +790,7 @@ bool mKCalEngine::startRequest(QOrganizerAbstractRequest *request)
 bool mKCalEngine::cancelRequest(QOrganizerAbstractRequest *request)
 {
     if (mRequests.removeAll(request) > 0) {
+        Tracer::asyncEnd("queued", request);
         updateRequestState(request, QOrganizerAbstractRequest::CanceledState);
     }
     return request->isCanceled();
@@ -508,19 +798,35 @@ bool mKCalEngine::cancelRequest(QOrganizerAbstractRequest *request)
 
 bool mKCalEngine::waitForRequestFinished(QOrganizerAbstractRequest *request, int msecs)
 {
-    int remaining = msecs;
-    if (mRunningRequest && mRunningRequest != request) {
-        QElapsedTimer timer;
+    QElapsedTimer timer;
+    if (msecs > 0) {
+        timer.start();
+    }
+    if (!mReady) {
+        // The queued requests are started once ready.
+        QTimer timeout;
+        QEventLoop loop;
+        connect(this, &mKCalEngine::ready, &loop, &QEventLoop::quit);
         if (msecs > 0) {
-            timer.start();
+            timeout.setSingleShot(true);
+            connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+            timeout.start(msecs);
         }
+        loop.exec();
+        if (!mReady) {
+            return false;
+        }
+    }
+    int remaining = timer.isValid() ? qMax(1, msecs - int(timer.elapsed())) : msecs;
+    if (mRunningRequest && mRunningRequest != request) {
         disconnect(mRunningRequest, &QOrganizerAbstractRequest::resultsAvailable,
                    this, &mKCalEngine::processRequests);
-        bool finished = waitForCurrentRequestFinished(msecs);
+        bool finished = waitForCurrentRequestFinished(remaining);
         remaining = timer.isValid() ? qMax(1, msecs - int(timer.elapsed())) : msecs;
         while (finished
                && !mRequests.isEmpty()
                && (mRunningRequest = mRequests.dequeue()) != request) {
+            Tracer::asyncEnd("queued", mRunningRequest);
             QMetaObject::invokeMethod(mWorker, "runRequest",
                                       Qt::QueuedConnection,
                                       Q_ARG(QtOrganizer::QOrganizerAbstractRequest*,
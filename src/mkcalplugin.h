@@ -52,16 +52,40 @@ public:
     QString managerName() const;
 };
 
+// Worker and its thread, shared by the engines opened on the same
+// database, time zone and options. They use a single cache and get
+// the changes of each other without watching the storage file.
+class SharedWorker
+{
+public:
+    ~SharedWorker();
+
+    static QSharedPointer<SharedWorker> acquire(const QTimeZone &timeZone,
+                                                const QString &databaseName,
+                                                const mKCalOptions &options);
+
+    mKCalWorker *worker() const;
+
+private:
+    SharedWorker(const QString &key);
+
+    QString mKey;
+    QThread mThread;
+    mKCalWorker *mWorker = nullptr;
+};
+
 class mKCalEngine : public QtOrganizer::QOrganizerManagerEngine
 {
     Q_OBJECT
 
 public:
     mKCalEngine(const QTimeZone &timeZone, const QString &databaseName,
+                const mKCalOptions &options = mKCalOptions(),
                 QObject *parent = nullptr);
     ~mKCalEngine();
 
     bool isOpened() const;
+    bool isReady() const;
 
     QString managerName() const override;
     QMap<QString, QString> managerParameters() const override;
@@ -115,20 +139,65 @@ public:
     bool removeCollection(const QtOrganizer::QOrganizerCollectionId &collectionId,
                           QtOrganizer::QOrganizerManager::Error *error) override;
 
+    int importItems(QIODevice *device,
+                    const QtOrganizer::QOrganizerCollectionId &collectionId,
+                    QtOrganizer::QOrganizerManager::Error *error,
+                    int commitSize = 1000);
+
+    ChangeLog::Feed changesSince(qint64 sequence,
+                                 QtOrganizer::QOrganizerManager::Error *error);
+    // Manager clients get the same report in the log,
+    // with the memoryReportInterval parameter.
+    MemoryReport memoryReport(QtOrganizer::QOrganizerManager::Error *error) const;
+    int moveItems(const QList<QtOrganizer::QOrganizerItemId> &itemIds,
+                  const QtOrganizer::QOrganizerCollectionId &collectionId,
+                  QtOrganizer::QOrganizerManager::Error *error);
+    int subscribe(const QList<QtOrganizer::QOrganizerCollectionId> &collectionIds,
+                  const QDateTime &startDateTime,
+                  const QDateTime &endDateTime,
+                  const QList<QtOrganizer::QOrganizerItemType::ItemType> &itemTypes,
+                  QtOrganizer::QOrganizerManager::Error *error);
+    void unsubscribe(int subscriptionId);
+    int removeMatchingItems(const QtOrganizer::QOrganizerItemFilter &filter,
+                            const QDateTime &startDateTime,
+                            const QDateTime &endDateTime,
+                            QtOrganizer::QOrganizerManager::Error *error);
+
     void requestDestroyed(QtOrganizer::QOrganizerAbstractRequest *request) override;
     bool startRequest(QtOrganizer::QOrganizerAbstractRequest *request) override;
     bool cancelRequest(QtOrganizer::QOrganizerAbstractRequest *request) override;
     bool waitForRequestFinished(QtOrganizer::QOrganizerAbstractRequest *request, int msecs) override;
 
+signals:
+    // Reported while the items of a removed collection are deleted.
+    void collectionRemovalProgress(const QtOrganizer::QOrganizerCollectionId &collectionId,
+                                   int removed, int total);
+    // Emitted once an engine created with the asyncOpen
+    // option has opened its storage, or failed to. On failure,
+    // dataChanged() is emitted too and the later calls report
+    // a PermissionsError, for the manager clients.
+    void ready(bool opened);
+
 private:
+    void setInitialised(bool opened);
+    void waitForReady();
     void processRequests();
+    void refreshCollections();
+    void setCollections(const QList<QtOrganizer::QOrganizerCollection> &collections);
+    void updateCollections(const QList<QtOrganizer::QOrganizerCollection> &collections);
     bool waitForCurrentRequestFinished(int msecs);
 
     QMap<QString, QString> mParameters;
-    QThread mWorkerThread;
+    QSharedPointer<SharedWorker> mSharedWorker;
     mKCalWorker *mWorker = nullptr;
     bool mOpened = false;
+    bool mReady = false;
+    bool mReadyNotified = false;
     QtOrganizer::QOrganizerCollectionId mDefaultCollectionId;
+    // Copy of the worker notebooks, so collection
+    // reads don't need a worker round trip.
+    QList<QtOrganizer::QOrganizerCollection> mCollections;
+    QHash<QtOrganizer::QOrganizerCollectionId, int> mCollectionIndex;
     QtOrganizer::QOrganizerAbstractRequest *mRunningRequest = nullptr;
     QQueue<QtOrganizer::QOrganizerAbstractRequest*> mRequests;
 };
@@ -48,17 +48,104 @@
 #include <QtOrganizer/QOrganizerTodoOccurrence>
 #include <QtOrganizer/QOrganizerJournal>
 
+#include <QtOrganizer/QOrganizerItemTimestamp>
+#include <QtOrganizer/QOrganizerItemDetailRangeFilter>
+#include <QtOrganizer/QOrganizerItemIntersectionFilter>
+#include <QtOrganizer/QOrganizerItemCollectionFilter>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include <limits>
+
+#include <KCalendarCore/ICalFormat>
+#include <KCalendarCore/MemoryCalendar>
+
 #include "helper.h"
+#include "changejournal.h"
+#include "notebookstatistics.h"
+#include "tracer.h"
 
 using namespace QtOrganizer;
 
+// Windows longer than a year are not worth prefetching.
+static const int MAX_PREFETCH_DAYS = 366;
+// Only the most recent changes are kept in the change log.
+static const int MAX_LOGGED_CHANGES = 10000;
+
+// Below this number of items, converting them in
+// parallel is not worth the thread synchronisation.
+static const int MIN_PARALLEL_ITEMS = 64;
+// Purge deleted incidences of local notebooks after this delay
+// in ms, or as soon as possible when too many are pending.
+static const int PURGE_DELAY = 2000;
+static const int MAX_PENDING_PURGES = 500;
+// Incidences of a removed notebook are deleted by
+// transactions of this size.
+static const int NOTEBOOK_REMOVAL_CHUNK = 1000;
+
+// Deleted incidences of local (non-synced) notebooks
+// don't need to be kept for a sync plugin.
+static bool isLocalNotebook(const mKCal::Notebook::Ptr &notebook)
+{
+    return notebook
+        && notebook->isMaster()
+        && !notebook->isShared()
+        && notebook->pluginName().isEmpty();
+}
+
 mKCalWorker::mKCalWorker(QObject *parent)
     : QOrganizerManagerEngine(parent)
+    , mPrefetchTimer(new QTimer(this))
+    , mFlushTimer(new QTimer(this))
+    , mMemoryReportTimer(new QTimer(this))
+    , mPurgeTimer(new QTimer(this))
+    , mNotificationTimer(new QTimer(this))
 {
+    // Fire when the event loop of the worker thread is idle.
+    mPrefetchTimer->setSingleShot(true);
+    mPrefetchTimer->setInterval(0);
+    connect(mPrefetchTimer, &QTimer::timeout,
+            this, &mKCalWorker::prefetch);
+
+    // Started on the first journaled change only, so changes
+    // done in a row are saved in one storage transaction.
+    mFlushTimer->setSingleShot(true);
+    connect(mFlushTimer, &QTimer::timeout,
+            this, [this] () {flush();});
+
+    mPurgeTimer->setSingleShot(true);
+    connect(mPurgeTimer, &QTimer::timeout,
+            this, &mKCalWorker::purge);
+
+    mNotificationTimer->setSingleShot(true);
+    connect(mNotificationTimer, &QTimer::timeout,
+            this, &mKCalWorker::emitPendingChanges);
+
+    connect(mMemoryReportTimer, &QTimer::timeout,
+            this, &mKCalWorker::logMemoryReport);
 }
 
 mKCalWorker::~mKCalWorker()
 {
+    if (mOpened && mFlushTimer->isActive()) {
+        flush();
+    }
+    if (mOpened && mPendingPurges > 0) {
+        purge();
+    }
+    // Kept for a later replay when the last flush failed.
+    if (mJournal && mJournal->isEmpty()) {
+        mJournal->remove();
+    }
+    delete mJournal;
+    delete mChangeLog;
+    delete mStatistics;
     if (mStorage) {
         mStorage->unregisterObserver(this);
         mStorage->close();
@@ -83,14 +170,29 @@ QMap<QString, QString> mKCalWorker::managerParameters() const
     return parameters;
 }
 
-bool mKCalWorker::init(const QTimeZone &timeZone, const QString &databaseName)
+bool mKCalWorker::init(const QTimeZone &timeZone, const QString &databaseName,
+                       const mKCalOptions &options, QObject *client)
 {
+    mClients.insert(client);
+    if (mCalendars) {
+        // Shared with a previous engine, only
+        // report the state to the new one.
+        QOrganizerManager::Error error;
+        if (!mDefaultNotebookUid.isEmpty()) {
+            emit defaultCollectionIdChanged(mDefaultNotebookUid);
+        }
+        emit collectionsRefreshed(collections(&error));
+        emit initialised(mOpened);
+        return mOpened;
+    }
+    mOptions = options;
     mCalendars = QSharedPointer<ItemCalendars>(new ItemCalendars(timeZone));
     if (databaseName.isEmpty()) {
-        mStorage = mKCal::SqliteStorage::Ptr(new mKCal::SqliteStorage(mCalendars));
+        mStorage = InstrumentedStorage(mKCal::SqliteStorage::Ptr(new mKCal::SqliteStorage(mCalendars)));
     } else {
-        mStorage = mKCal::SqliteStorage::Ptr(new mKCal::SqliteStorage(mCalendars, databaseName));
+        mStorage = InstrumentedStorage(mKCal::SqliteStorage::Ptr(new mKCal::SqliteStorage(mCalendars, databaseName)));
     }
+    mLastExternalSync = QDateTime::currentDateTimeUtc();
     mOpened = mStorage->open();
     mKCal::Notebook::Ptr nb = mStorage->defaultNotebook();
     if (mOpened && !nb) {
@@ -106,9 +208,153 @@ bool mKCalWorker::init(const QTimeZone &timeZone, const QString &databaseName)
     }
     mStorage->registerObserver(this);
 
+    if (mOpened) {
+        replayJournals();
+        if (mOptions.writeBehind) {
+            // One journal per session, so a flush only
+            // clears the changes of this worker.
+            mJournal = new ChangeJournal(QStringLiteral("%1-writebehind-%2-%3")
+                                         .arg(mStorage->databaseName())
+                                         .arg(QCoreApplication::applicationPid())
+                                         .arg(quintptr(this), 0, 16));
+            if (!mJournal->open()) {
+                delete mJournal;
+                mJournal = nullptr;
+            }
+        }
+        mFlushTimer->setInterval(mOptions.flushInterval);
+        mNotificationTimer->setInterval(mOptions.notificationWindow);
+        if (mOptions.memoryReportInterval > 0) {
+            mMemoryReportTimer->start(mOptions.memoryReportInterval);
+        }
+    }
+
+    if (mOpened) {
+        mChangeLog = new ChangeLog(mStorage->databaseName()
+                                   + QStringLiteral("-changes"));
+        if (!mChangeLog->open()) {
+            delete mChangeLog;
+            mChangeLog = nullptr;
+        } else {
+            mExternalLogSequence = mChangeLog->lastSequence();
+        }
+        mStatistics = new NotebookStatistics(mStorage->databaseName());
+        if (!mStatistics->open()) {
+            delete mStatistics;
+            mStatistics = nullptr;
+        }
+
+        // Deletions of a previous session that were not purged yet.
+        for (const mKCal::Notebook::Ptr &nb : mStorage.notebooks()) {
+            mKnownNotebookUids.insert(nb->uid());
+            KCalendarCore::Incidence::List deleted;
+            if (isLocalNotebook(nb)
+                && mStorage->deletedIncidences(&deleted, QDateTime(), nb->uid())
+                && !deleted.isEmpty()) {
+                mPurgeQueue[nb->uid()].append(deleted);
+                mPendingPurges += deleted.count();
+            }
+        }
+        schedulePurge();
+    }
+
+    QOrganizerManager::Error error;
+    emit collectionsRefreshed(collections(&error));
+    emit initialised(mOpened);
+
     return mOpened;
 }
 
+// Write pending changes to the storage, they
+// don't need to be journaled anymore.
+bool mKCalWorker::flush(mKCal::ExtendedStorage::DeleteAction deleteAction)
+{
+    mFlushTimer->stop();
+    // Deletions are purged in the same transaction, skip
+    // the purge done on storage update.
+    mPurged = (deleteAction == mKCal::ExtendedStorage::PurgeDeleted);
+    Tracer::Span span("save");
+    if (Tracer::isEnabled()) {
+        span.setArg(QStringLiteral("purge"), mPurged);
+    }
+    const bool ok = mStorage.save(deleteAction);
+    mPurged = false;
+    if (!ok) {
+        return false;
+    }
+    if (mJournal && !mJournal->isEmpty()) {
+        mJournal->clear();
+    }
+    mUnflushedUids.clear();
+    return true;
+}
+
+// Durably record the given incidences, falling back
+// to a synchronous save on failure.
+bool mKCalWorker::journal(const KCalendarCore::Incidence::List &incidences)
+{
+    for (const KCalendarCore::Incidence::Ptr &incidence : incidences) {
+        if (incidence
+            && !mJournal->append(incidence, mCalendars->notebook(incidence))) {
+            return false;
+        }
+    }
+    if (!mJournal->sync()) {
+        return false;
+    }
+    for (const KCalendarCore::Incidence::Ptr &incidence : incidences) {
+        if (incidence) {
+            mUnflushedUids.insert(incidence->uid());
+        }
+    }
+    return true;
+}
+
+// Apply the journal records to the incidences as they are in the
+// storage. Records are full incidences, so replaying changes that
+// were already saved is harmless.
+bool mKCalWorker::replayJournal(const ChangeJournal &journal)
+{
+    for (const ChangeJournal::Entry &entry : journal.entries()) {
+        const KCalendarCore::Incidence::Ptr &incidence = entry.incidence;
+        mStorage.load(incidence->uid());
+        KCalendarCore::Incidence::Ptr existing
+            = mCalendars->incidence(incidence->uid(), incidence->recurrenceId());
+        if (!existing) {
+            mCalendars->addIncidence(incidence, entry.notebookUid);
+        } else if (existing->type() == incidence->type()) {
+            // Moved to another notebook before the crash.
+            if (mCalendars->notebook(existing) != entry.notebookUid
+                && !mCalendars->moveIncidence(existing, entry.notebookUid)) {
+                return false;
+            }
+            existing->update();
+            *existing = *incidence;
+            existing->updated();
+        }
+    }
+    return flush();
+}
+
+// Replay the journals of the write-behind sessions that ended
+// before flushing. Journals still locked belong to live sessions.
+void mKCalWorker::replayJournals()
+{
+    const QFileInfo database(mStorage->databaseName());
+    const QFileInfoList journals = database.dir().entryInfoList(
+        QStringList() << database.fileName() + QStringLiteral("-writebehind-*"),
+        QDir::Files);
+    for (const QFileInfo &info : journals) {
+        if (info.suffix() == QStringLiteral("lock")) {
+            continue;
+        }
+        ChangeJournal journal(info.filePath());
+        if (journal.open() && (journal.isEmpty() || replayJournal(journal))) {
+            journal.remove();
+        }
+    }
+}
+
 void mKCalWorker::storageModified(mKCal::ExtendedStorage *storage,
                                   const QString &info)
 {
@@ -122,7 +368,137 @@ void mKCalWorker::storageModified(mKCal::ExtendedStorage *storage,
             emit defaultCollectionIdChanged(mDefaultNotebookUid);
         }
     }
-    emit dataChanged();
+
+    QStringList addedIds;
+    QStringList modifiedIds;
+    QStringList removedIds;
+    QSet<QString> notebookUids;
+    QList<ChangeLog::Change> changes;
+    const bool complete = reloadExternalChanges(&addedIds, &modifiedIds, &removedIds,
+                                                &notebookUids, &changes);
+    logExternalChanges(changes, complete);
+    const bool notebooksChanged = (notebookUids != mKnownNotebookUids);
+    mKnownNotebookUids = notebookUids;
+    // Only the notebooks with listed changes are counted again.
+    if (mStatistics && !complete) {
+        mStatistics->invalidateAll();
+    } else if (mStatistics) {
+        for (const ChangeLog::Change &change : changes) {
+            mStatistics->invalidate(change.notebookUid);
+        }
+    }
+    // Notebook properties may have changed as well.
+    QOrganizerManager::Error error;
+    emit collectionsRefreshed(collections(&error));
+
+    // Changes that are not item changes, like notebook ones,
+    // or item changes that could not be listed.
+    if (!complete || notebooksChanged
+        || (addedIds.isEmpty() && modifiedIds.isEmpty() && removedIds.isEmpty())) {
+        emit dataChanged();
+    }
+    notifyItemsUpdated(addedIds, modifiedIds, removedIds,
+                       QHash<QString, QList<QOrganizerItemDetail::DetailType>>());
+}
+
+// Storage dates are in seconds, as ICal ones, so serialised
+// incidences are equal when nothing was changed externally.
+static bool isSameIncidence(const KCalendarCore::Incidence::Ptr &a,
+                            const KCalendarCore::Incidence::Ptr &b)
+{
+    KCalendarCore::ICalFormat format;
+    return a->revision() == b->revision()
+        && a->lastModified().toSecsSinceEpoch() == b->lastModified().toSecsSinceEpoch()
+        && format.toICalString(a) == format.toICalString(b);
+}
+
+// Bring the calendar up to date with the incidences written by
+// other processes since the last call, instead of reloading
+// everything. Own changes are found too, but are skipped since
+// the calendar already holds them.
+bool mKCalWorker::reloadExternalChanges(QStringList *addedIds,
+                                        QStringList *modifiedIds,
+                                        QStringList *removedIds,
+                                        QSet<QString> *notebookUids,
+                                        QList<ChangeLog::Change> *changes)
+{
+    // Overlap by a second, storage dates are not more precise.
+    const QDateTime since = mLastExternalSync.addSecs(-1);
+    mLastExternalSync = QDateTime::currentDateTimeUtc();
+
+    bool complete = true;
+    // These changes are already in the database, the storage
+    // must not record them again.
+    mCalendars->unregisterObserver(mStorage.data());
+    for (const mKCal::Notebook::Ptr &notebook : mStorage.notebooks()) {
+        notebookUids->insert(notebook->uid());
+        KCalendarCore::Incidence::List inserted;
+        KCalendarCore::Incidence::List modified;
+        KCalendarCore::Incidence::List deleted;
+        if (!mStorage->insertedIncidences(&inserted, since, notebook->uid())
+            || !mStorage->modifiedIncidences(&modified, since, notebook->uid())
+            || !mStorage->deletedIncidences(&deleted, since, notebook->uid())) {
+            complete = false;
+            continue;
+        }
+        const int insertedCount = inserted.count();
+        int index = 0;
+        for (const KCalendarCore::Incidence::Ptr &incidence : inserted + modified) {
+            const bool isInserted = (index++ < insertedCount);
+            // Local changes not flushed yet win, the storage
+            // will write them over the external ones.
+            if (mUnflushedUids.contains(incidence->uid())) {
+                continue;
+            }
+            KCalendarCore::Incidence::Ptr existing
+                = mCalendars->incidence(incidence->uid(), incidence->recurrenceId());
+            if (existing && isSameIncidence(existing, incidence)
+                && mCalendars->notebook(existing) == notebook->uid()) {
+                continue;
+            }
+            ChangeLog::Change change;
+            change.uid = incidence->instanceIdentifier();
+            change.operation = isInserted ? ChangeLog::ItemAdded : ChangeLog::ItemModified;
+            change.notebookUid = notebook->uid();
+            *changes << change;
+            // Replaced rather than assigned, an update would
+            // change its last modification date.
+            if (existing) {
+                // Both tested, to notify the clients of either.
+                const bool before = isNotified(existing, mCalendars->notebook(existing));
+                const bool after = isNotified(incidence, notebook->uid());
+                if (before || after) {
+                    *modifiedIds << incidence->instanceIdentifier();
+                }
+                mCalendars->deleteIncidence(existing);
+            } else if (isNotified(incidence, notebook->uid())) {
+                *addedIds << incidence->instanceIdentifier();
+            }
+            mCalendars->addIncidence(incidence, notebook->uid());
+        }
+        for (const KCalendarCore::Incidence::Ptr &incidence : deleted) {
+            if (mUnflushedUids.contains(incidence->uid())) {
+                continue;
+            }
+            ChangeLog::Change change;
+            change.uid = incidence->instanceIdentifier();
+            change.operation = ChangeLog::ItemRemoved;
+            change.notebookUid = notebook->uid();
+            *changes << change;
+            // Incidences never loaded cannot be known by clients.
+            KCalendarCore::Incidence::Ptr existing
+                = mCalendars->incidence(incidence->uid(), incidence->recurrenceId());
+            if (existing) {
+                if (isNotified(existing, notebook->uid())) {
+                    *removedIds << incidence->instanceIdentifier();
+                }
+                mCalendars->deleteIncidence(existing);
+            }
+        }
+    }
+    mCalendars->registerObserver(mStorage.data());
+
+    return complete;
 }
 
 void mKCalWorker::storageUpdated(mKCal::ExtendedStorage *storage,
@@ -135,72 +511,635 @@ void mKCalWorker::storageUpdated(mKCal::ExtendedStorage *storage,
     QStringList addedIds;
     QStringList modifiedIds;
     QStringList removedIds;
+    QHash<QString, QList<QOrganizerItemDetail::DetailType>> details;
+    QList<ChangeLog::Change> changes;
 
-    QList<QPair<QOrganizerItemId, QOrganizerManager::Operation>> ops;
+    // Content of a notebook being removed, notified
+    // as a collection removal at the end.
+    auto isRemoved = [this] (const KCalendarCore::Incidence::Ptr &incidence) {
+        return !mRemovingNotebookUid.isEmpty()
+            && mCalendars->notebook(incidence) == mRemovingNotebookUid;
+    };
 
-    QList<QOrganizerItemId> ids;
-
-    ids.clear();
     for (const KCalendarCore::Incidence::Ptr &incidence : added) {
-        addedIds << incidence->instanceIdentifier();
-        const QOrganizerItemId id = itemId(incidence->instanceIdentifier().toUtf8());
-        ids << id;
-        ops << QPair<QOrganizerItemId, QOrganizerManager::Operation>(id, QOrganizerManager::Add);
-    }
-    if (!ids.isEmpty()) {
-        emit itemsAdded(ids);
+        if (isRemoved(incidence)) {
+            continue;
+        }
+        mCalendars->takeChangedDetails(incidence->instanceIdentifier());
+        changes << logChange(incidence, ChangeLog::ItemAdded);
+        if (mStatistics) {
+            mStatistics->added(changes.last().notebookUid, incidence);
+        }
+        if (isNotified(incidence, changes.last().notebookUid)) {
+            addedIds << incidence->instanceIdentifier();
+        }
     }
-
-    ids.clear();
     for (const KCalendarCore::Incidence::Ptr &incidence : modified) {
-        modifiedIds << incidence->instanceIdentifier();
-        const QOrganizerItemId id = itemId(incidence->instanceIdentifier().toUtf8());
-        ids << id;
-        ops << QPair<QOrganizerItemId, QOrganizerManager::Operation>(id, QOrganizerManager::Change);
-    }
-    if (!ids.isEmpty()) {
-        emit itemsChanged(ids, QList<QOrganizerItemDetail::DetailType>());
+        if (isRemoved(incidence)) {
+            continue;
+        }
+        const QList<QOrganizerItemDetail::DetailType> types
+            = mCalendars->takeChangedDetails(incidence->instanceIdentifier());
+        changes << logChange(incidence, ChangeLog::ItemModified);
+        // The previous dates or collection are not known anymore,
+        // the item may have just left the subscribed window.
+        const bool moved = types.isEmpty()
+            || types.contains(QOrganizerItemDetail::TypeEventTime)
+            || types.contains(QOrganizerItemDetail::TypeTodoTime)
+            || types.contains(QOrganizerItemDetail::TypeJournalTime)
+            || types.contains(QOrganizerItemDetail::TypeRecurrence);
+        if (mStatistics) {
+            mStatistics->modified(changes.last().notebookUid, incidence, moved);
+        }
+        if (isNotified(incidence, changes.last().notebookUid, moved)) {
+            modifiedIds << incidence->instanceIdentifier();
+            details.insert(incidence->instanceIdentifier(), types);
+        }
     }
-
-    ids.clear();
-    QMap<QString, KCalendarCore::Incidence::List> purgeList;
     for (const KCalendarCore::Incidence::Ptr &incidence : deleted) {
-        removedIds << incidence->instanceIdentifier();
-        const QOrganizerItemId id = itemId(incidence->instanceIdentifier().toUtf8());
-        ids << id;
-        ops << QPair<QOrganizerItemId, QOrganizerManager::Operation>(id, QOrganizerManager::Remove);
+        if (isRemoved(incidence)) {
+            continue;
+        }
+        mCalendars->takeChangedDetails(incidence->instanceIdentifier());
+        changes << logChange(incidence, ChangeLog::ItemRemoved);
+        if (mStatistics) {
+            mStatistics->removed(changes.last().notebookUid, incidence);
+        }
+        if (isNotified(incidence, changes.last().notebookUid)) {
+            removedIds << incidence->instanceIdentifier();
+        }
         // if the incidence was stored in a local (non-synced) notebook, purge it.
         mKCal::Notebook::Ptr notebook = mStorage->notebook(mCalendars->notebook(incidence));
-        if (notebook
-            && notebook->isMaster()
-            && !notebook->isShared()
-            && notebook->pluginName().isEmpty()) {
-            QMap<QString, KCalendarCore::Incidence::List>::Iterator it = purgeList.find(notebook->uid());
-            if (it == purgeList.end()) {
-                purgeList.insert(notebook->uid(), KCalendarCore::Incidence::List() << incidence);
-            } else {
-                it->append(incidence);
+        if (!mPurged && isLocalNotebook(notebook)) {
+            mPurgeQueue[notebook->uid()].append(incidence);
+            mPendingPurges += 1;
+        }
+    }
+    schedulePurge();
+
+    if (mChangeLog && mChangeLog->append(changes)) {
+        mChangeLog->compact(MAX_LOGGED_CHANGES);
+    }
+    if (mStatistics && !changes.isEmpty()) {
+        QSet<QString> notebookUids = mMovedFromNotebookUids;
+        for (const ChangeLog::Change &change : changes) {
+            notebookUids.insert(change.notebookUid);
+        }
+        emit collectionStatisticsChanged(notebookCollections(notebookUids));
+    }
+    mMovedFromNotebookUids.clear();
+
+    notifyItemsUpdated(addedIds, modifiedIds, removedIds, details);
+}
+
+// Emit the changes at once, or merge them with the changes
+// not notified yet when a notification window is set.
+void mKCalWorker::notifyItemsUpdated(const QStringList &addedIds,
+                                     const QStringList &modifiedIds,
+                                     const QStringList &removedIds,
+                                     const QHash<QString, QList<QOrganizerItemDetail::DetailType>> &details)
+{
+    if (mOptions.notificationWindow <= 0) {
+        emitItemsUpdated(addedIds, modifiedIds, removedIds, details);
+        return;
+    }
+
+    // Merge with the changes not notified yet.
+    for (const QString &id : addedIds) {
+        coalesce(id, QOrganizerManager::Add);
+    }
+    for (const QString &id : modifiedIds) {
+        coalesce(id, QOrganizerManager::Change, details.value(id));
+    }
+    for (const QString &id : removedIds) {
+        coalesce(id, QOrganizerManager::Remove);
+    }
+    // Not restarted on later changes, to bound the latency.
+    if (!mPendingChanges.isEmpty() && !mNotificationTimer->isActive()) {
+        mNotificationTimer->start();
+    }
+}
+
+ChangeLog::Change mKCalWorker::logChange(const KCalendarCore::Incidence::Ptr &incidence,
+                                         ChangeLog::Operation operation) const
+{
+    ChangeLog::Change change;
+    change.uid = incidence->instanceIdentifier();
+    change.operation = operation;
+    change.notebookUid = mCalendars->notebook(incidence);
+    return change;
+}
+
+void mKCalWorker::logNotebookChanges(const QStringList &addedUids,
+                                     const QStringList &modifiedUids,
+                                     const QStringList &removedUids)
+{
+    if (!mChangeLog) {
+        return;
+    }
+    QList<ChangeLog::Change> changes;
+    for (const QString &uid : addedUids) {
+        ChangeLog::Change change;
+        change.operation = ChangeLog::NotebookAdded;
+        change.notebookUid = uid;
+        changes << change;
+    }
+    for (const QString &uid : modifiedUids) {
+        ChangeLog::Change change;
+        change.operation = ChangeLog::NotebookModified;
+        change.notebookUid = uid;
+        changes << change;
+    }
+    for (const QString &uid : removedUids) {
+        ChangeLog::Change change;
+        change.operation = ChangeLog::NotebookRemoved;
+        change.notebookUid = uid;
+        changes << change;
+    }
+    if (mChangeLog->append(changes)) {
+        mChangeLog->compact(MAX_LOGGED_CHANGES);
+    }
+}
+
+// Log the item changes found in the storage. Changes done through
+// this plugin, by this process or others, are logged already and
+// skipped, at worst a change is logged twice.
+void mKCalWorker::logExternalChanges(const QList<ChangeLog::Change> &changes,
+                                     bool complete)
+{
+    if (!mChangeLog) {
+        return;
+    }
+    if (!complete) {
+        mChangeLog->markIncomplete();
+    }
+    const ChangeLog::Feed logged = mChangeLog->changesSince(mExternalLogSequence);
+    QSet<QString> loggedUids;
+    for (const ChangeLog::Change &change : logged.changes) {
+        loggedUids.insert(change.uid);
+    }
+    QList<ChangeLog::Change> external;
+    for (const ChangeLog::Change &change : changes) {
+        if (!loggedUids.contains(change.uid)) {
+            external << change;
+        }
+    }
+    // Reloads overlap, read again what is logged now next time.
+    mExternalLogSequence = logged.lastSequence;
+    if (mChangeLog->append(external)) {
+        mChangeLog->compact(MAX_LOGGED_CHANGES);
+    }
+}
+
+// Return the changes logged after sequence, by any process using
+// this database. Start from 0 to get all retained changes.
+ChangeLog::Feed mKCalWorker::changesSince(qint64 sequence)
+{
+    if (!mChangeLog) {
+        return ChangeLog::Feed();
+    }
+    return mChangeLog->changesSince(sequence);
+}
+
+// Register the interest of a client in the given items only.
+// Without any subscription, all changes are notified.
+int mKCalWorker::subscribe(const ItemSubscription &subscription)
+{
+    mLastSubscriptionId += 1;
+    mSubscriptions.insert(mLastSubscriptionId, subscription);
+    mSubscribedClients[subscription.client] += 1;
+    return mLastSubscriptionId;
+}
+
+void mKCalWorker::unsubscribe(int subscriptionId)
+{
+    QHash<int, ItemSubscription>::Iterator it = mSubscriptions.find(subscriptionId);
+    if (it != mSubscriptions.end()) {
+        if (--mSubscribedClients[it->client] == 0) {
+            mSubscribedClients.remove(it->client);
+        }
+        mSubscriptions.erase(it);
+    }
+}
+
+// Called when an engine sharing this worker is deleted.
+void mKCalWorker::detach(QObject *client)
+{
+    mClients.remove(client);
+    QHash<int, ItemSubscription>::Iterator it = mSubscriptions.begin();
+    while (it != mSubscriptions.end()) {
+        if (it->client == client) {
+            it = mSubscriptions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    mSubscribedClients.remove(client);
+}
+
+static QOrganizerItemType::ItemType itemType(const KCalendarCore::Incidence::Ptr &incidence)
+{
+    switch (incidence->type()) {
+    case KCalendarCore::Incidence::TypeEvent:
+        return incidence->hasRecurrenceId()
+            ? QOrganizerItemType::TypeEventOccurrence : QOrganizerItemType::TypeEvent;
+    case KCalendarCore::Incidence::TypeTodo:
+        return incidence->hasRecurrenceId()
+            ? QOrganizerItemType::TypeTodoOccurrence : QOrganizerItemType::TypeTodo;
+    case KCalendarCore::Incidence::TypeJournal:
+        return QOrganizerItemType::TypeJournal;
+    default:
+        return QOrganizerItemType::TypeUndefined;
+    }
+}
+
+// Tell if a change of incidence should be notified, recording
+// the subscribed clients to notify of it. With anyWindow, only
+// the item type is tested, for changes that may have moved
+// the item out of the subscribed collections or dates.
+bool mKCalWorker::isNotified(const KCalendarCore::Incidence::Ptr &incidence,
+                             const QString &notebookUid, bool anyWindow)
+{
+    if (mSubscriptions.isEmpty()) {
+        return true;
+    }
+
+    QSet<QObject*> clients;
+    const QOrganizerItemType::ItemType type = itemType(incidence);
+    for (const ItemSubscription &subscription : mSubscriptions) {
+        if (clients.contains(subscription.client)) {
+            continue;
+        }
+        if (!subscription.itemTypes.isEmpty()
+            && !subscription.itemTypes.contains(type)) {
+            continue;
+        }
+        if (anyWindow) {
+            clients.insert(subscription.client);
+            continue;
+        }
+        if (!subscription.collectionIds.isEmpty()) {
+            bool inCollections = false;
+            for (const QOrganizerCollectionId &id : subscription.collectionIds) {
+                if (id.localId() == notebookUid.toUtf8()) {
+                    inCollections = true;
+                    break;
+                }
             }
+            if (!inCollections) {
+                continue;
+            }
+        }
+        if (mCalendars->occursIn(incidence, subscription.startDateTime,
+                                 subscription.endDateTime)) {
+            clients.insert(subscription.client);
         }
     }
-    if (!ids.isEmpty()) {
-        emit itemsRemoved(ids);
+    if (!clients.isEmpty()) {
+        mRecipients[incidence->instanceIdentifier()].unite(clients);
     }
+    // Engines without subscription want all the changes.
+    return !clients.isEmpty() || mSubscribedClients.count() < mClients.count();
+}
 
-    for (QMap<QString, KCalendarCore::Incidence::List>::ConstIterator it = purgeList.constBegin(); it != purgeList.constEnd(); ++it) {
-        mStorage->purgeDeletedIncidences(it.value(), it.key());
+void mKCalWorker::coalesce(const QString &id, QOrganizerManager::Operation operation,
+                           const QList<QOrganizerItemDetail::DetailType> &details)
+{
+    QHash<QString, QOrganizerManager::Operation>::Iterator it = mPendingChanges.find(id);
+    if (it == mPendingChanges.end()) {
+        mPendingChanges.insert(id, operation);
+        mPendingOrder.append(id);
+        if (operation == QOrganizerManager::Change) {
+            mPendingDetails.insert(id, details);
+        }
+    } else if (it.value() == QOrganizerManager::Add) {
+        // Added then changed is still an addition,
+        // added then removed was never there.
+        if (operation == QOrganizerManager::Remove) {
+            mPendingChanges.erase(it);
+        }
+    } else if (it.value() == QOrganizerManager::Remove) {
+        // Removed then added again under the same id.
+        if (operation == QOrganizerManager::Add) {
+            it.value() = QOrganizerManager::Change;
+            mPendingDetails.insert(id, QList<QOrganizerItemDetail::DetailType>());
+        }
+    } else if (operation == QOrganizerManager::Change) {
+        // An empty list stands for any detail.
+        QList<QOrganizerItemDetail::DetailType> &pending = mPendingDetails[id];
+        if (details.isEmpty()) {
+            pending.clear();
+        } else if (!pending.isEmpty()) {
+            for (QOrganizerItemDetail::DetailType type : details) {
+                if (!pending.contains(type)) {
+                    pending.append(type);
+                }
+            }
+            std::sort(pending.begin(), pending.end());
+        }
+    } else {
+        it.value() = operation;
+    }
+}
+
+void mKCalWorker::emitPendingChanges()
+{
+    mNotificationTimer->stop();
+
+    QStringList addedIds;
+    QStringList modifiedIds;
+    QStringList removedIds;
+    // Dropped ids are still listed in mPendingOrder, possibly
+    // several times if they came back, emit them once.
+    for (const QString &id : mPendingOrder) {
+        QHash<QString, QOrganizerManager::Operation>::Iterator it = mPendingChanges.find(id);
+        if (it == mPendingChanges.end()) {
+            continue;
+        }
+        const QOrganizerManager::Operation operation = it.value();
+        mPendingChanges.erase(it);
+        switch (operation) {
+        case QOrganizerManager::Add:
+            addedIds << id;
+            break;
+        case QOrganizerManager::Change:
+            modifiedIds << id;
+            break;
+        case QOrganizerManager::Remove:
+            removedIds << id;
+            break;
+        }
+    }
+    const QHash<QString, QList<QOrganizerItemDetail::DetailType>> details = mPendingDetails;
+    mPendingChanges.clear();
+    mPendingOrder.clear();
+    mPendingDetails.clear();
+
+    if (!addedIds.isEmpty() || !modifiedIds.isEmpty() || !removedIds.isEmpty()) {
+        emitItemsUpdated(addedIds, modifiedIds, removedIds, details);
+    }
+}
+
+void mKCalWorker::emitItemsUpdated(const QStringList &addedIds,
+                                   const QStringList &modifiedIds,
+                                   const QStringList &removedIds,
+                                   const QHash<QString, QList<QOrganizerItemDetail::DetailType>> &details)
+{
+    Tracer::Span span("notify");
+    if (Tracer::isEnabled()) {
+        span.setArg(QStringLiteral("added"), addedIds.count());
+        span.setArg(QStringLiteral("changed"), modifiedIds.count());
+        span.setArg(QStringLiteral("removed"), removedIds.count());
+    }
+
+    // The engines without subscription get all the changes,
+    // each subscribed engine the items of its subscriptions.
+    QSet<QObject*> unsubscribed;
+    for (QObject *client : mClients) {
+        if (!mSubscribedClients.contains(client)) {
+            unsubscribed.insert(client);
+        }
+    }
+    if (!unsubscribed.isEmpty()) {
+        emitChangeSet(addedIds, modifiedIds, removedIds, details, unsubscribed);
+    }
+    for (QHash<QObject*, int>::ConstIterator it = mSubscribedClients.constBegin();
+         it != mSubscribedClients.constEnd(); ++it) {
+        QObject *client = it.key();
+        auto recipients = [this, client] (const QStringList &ids) {
+            QStringList filtered;
+            for (const QString &id : ids) {
+                QHash<QString, QSet<QObject*>>::ConstIterator found = mRecipients.constFind(id);
+                if (found != mRecipients.constEnd() && found->contains(client)) {
+                    filtered << id;
+                }
+            }
+            return filtered;
+        };
+        emitChangeSet(recipients(addedIds), recipients(modifiedIds),
+                      recipients(removedIds), details, QSet<QObject*>() << client);
     }
+    mRecipients.clear();
+}
+
+void mKCalWorker::emitChangeSet(const QStringList &addedIds,
+                                const QStringList &modifiedIds,
+                                const QStringList &removedIds,
+                                const QHash<QString, QList<QOrganizerItemDetail::DetailType>> &details,
+                                const QSet<QObject*> &clients)
+{
+    QSharedPointer<ItemChangeSet> changes(new ItemChangeSet);
+    changes->clients = clients;
+    changes->operations.reserve(addedIds.count() + modifiedIds.count() + removedIds.count());
 
-    if (!ops.isEmpty()) {
-        emit itemsModified(ops);
+    changes->added.reserve(addedIds.count());
+    for (const QString &localId : addedIds) {
+        const QOrganizerItemId id = itemId(localId.toUtf8());
+        changes->added << id;
+        changes->operations << QPair<QOrganizerItemId, QOrganizerManager::Operation>(id, QOrganizerManager::Add);
+    }
+    changes->changed.reserve(modifiedIds.count());
+    for (const QString &localId : modifiedIds) {
+        const QOrganizerItemId id = itemId(localId.toUtf8());
+        changes->changed << id;
+        changes->operations << QPair<QOrganizerItemId, QOrganizerManager::Operation>(id, QOrganizerManager::Change);
+        // Group the ids sharing the same changed details,
+        // there are usually only a few distinct sets.
+        const QList<QOrganizerItemDetail::DetailType> types = details.value(localId);
+        bool grouped = false;
+        for (ItemChangeSet::DetailChanges &group : changes->changedDetails) {
+            if (group.second == types) {
+                group.first << id;
+                grouped = true;
+                break;
+            }
+        }
+        if (!grouped) {
+            changes->changedDetails << ItemChangeSet::DetailChanges(QList<QOrganizerItemId>() << id, types);
+        }
+    }
+    changes->removed.reserve(removedIds.count());
+    for (const QString &localId : removedIds) {
+        const QOrganizerItemId id = itemId(localId.toUtf8());
+        changes->removed << id;
+        changes->operations << QPair<QOrganizerItemId, QOrganizerManager::Operation>(id, QOrganizerManager::Remove);
+    }
+
+    if (!changes->operations.isEmpty()) {
+        emit itemsUpdated(changes);
     }
-    
-    emit itemsUpdated(addedIds, modifiedIds, removedIds);
+}
+
+bool mKCalWorker::loadRange(const QDate &start, const QDate &end)
+{
+    Tracer::Span span("load");
+    if (Tracer::isEnabled()) {
+        span.setArg(QStringLiteral("start"), start.toString(Qt::ISODate));
+        span.setArg(QStringLiteral("end"), end.toString(Qt::ISODate));
+    }
+    if (!mStorage.load(start, end)) {
+        return false;
+    }
+
+    // Keep the loaded ranges sorted and merged, as Julian days,
+    // an invalid date standing for an open bound.
+    QPair<qint64, qint64> range(start.isValid() ? start.toJulianDay()
+                                : std::numeric_limits<qint64>::min(),
+                                end.isValid() ? end.toJulianDay()
+                                : std::numeric_limits<qint64>::max());
+    QList<QPair<qint64, qint64>>::Iterator it = mLoadedRanges.begin();
+    while (it != mLoadedRanges.end() && it->second < range.first) {
+        ++it;
+    }
+    while (it != mLoadedRanges.end() && it->first <= range.second) {
+        range.first = qMin(range.first, it->first);
+        range.second = qMax(range.second, it->second);
+        it = mLoadedRanges.erase(it);
+    }
+    mLoadedRanges.insert(it, range);
+    return true;
+}
+
+// Whether the storage considers the incidence as already loaded,
+// so it would not come back with a later range load and must stay
+// in memory. Recurring and undated incidences are loaded with the
+// first range, with a day of margin for time zone shifts.
+bool mKCalWorker::isInLoadedRange(const KCalendarCore::Incidence::Ptr &incidence) const
+{
+    if (mLoadedRanges.isEmpty()) {
+        return false;
+    }
+    QDateTime start = incidence->dtStart();
+    QDateTime end = incidence->dateTime(KCalendarCore::Incidence::RoleEnd);
+    if (!start.isValid()) {
+        start = end;
+    } else if (!end.isValid()) {
+        end = start;
+    }
+    if (incidence->recurs() || incidence->hasRecurrenceId() || !start.isValid()) {
+        return true;
+    }
+    const qint64 first = start.toTimeZone(mCalendars->timeZone()).date().toJulianDay() - 1;
+    const qint64 last = end.toTimeZone(mCalendars->timeZone()).date().toJulianDay() + 1;
+    for (const QPair<qint64, qint64> &range : mLoadedRanges) {
+        if (range.first <= last && first <= range.second) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Approximate memory held by an incidence: the object itself,
+// its strings and its attendees, alarms and recurrence.
+static qint64 estimatedSize(const KCalendarCore::Incidence::Ptr &incidence)
+{
+    qint64 size = 512;
+    size += 2 * (incidence->uid().size() + incidence->summary().size()
+                 + incidence->description().size() + incidence->location().size());
+    for (const KCalendarCore::Attendee &attendee : incidence->attendees()) {
+        size += 64 + 2 * (attendee.name().size() + attendee.email().size());
+    }
+    size += 128 * incidence->alarms().count();
+    if (incidence->recurs()) {
+        size += 256 * (incidence->recurrence()->rRules().count()
+                       + incidence->recurrence()->exRules().count());
+        size += 8 * (incidence->recurrence()->rDateTimes().count()
+                     + incidence->recurrence()->exDateTimes().count());
+    }
+    return size;
+}
+
+MemoryReport mKCalWorker::memoryReport() const
+{
+    MemoryReport report;
+    if (!mCalendars) {
+        return report;
+    }
+
+    for (const KCalendarCore::Incidence::Ptr &incidence : mCalendars->incidences()) {
+        switch (incidence->type()) {
+        case KCalendarCore::Incidence::TypeEvent:
+            report.eventCount += 1;
+            break;
+        case KCalendarCore::Incidence::TypeTodo:
+            report.todoCount += 1;
+            break;
+        case KCalendarCore::Incidence::TypeJournal:
+            report.journalCount += 1;
+            break;
+        default:
+            break;
+        }
+        if (incidence->recurs()) {
+            report.recurringCount += 1;
+        }
+        if (incidence->hasRecurrenceId()) {
+            report.exceptionCount += 1;
+        }
+        report.estimatedBytes += estimatedSize(incidence);
+    }
+    for (const QPair<qint64, qint64> &range : mLoadedRanges) {
+        report.loadedRanges << QPair<QDate, QDate>(
+            range.first == std::numeric_limits<qint64>::min()
+            ? QDate() : QDate::fromJulianDay(range.first),
+            range.second == std::numeric_limits<qint64>::max()
+            ? QDate() : QDate::fromJulianDay(range.second));
+    }
+    report.indexEntryCount = mCalendars->indexEntryCount();
+    report.pendingNotificationCount = mPendingChanges.count();
+    report.pendingPurgeCount = mPendingPurges;
+    report.clientCount = mClients.count();
+
+    return report;
+}
+
+void mKCalWorker::logMemoryReport() const
+{
+    const MemoryReport report = memoryReport();
+    qInfo("mKCal worker: %d events, %d todos, %d journals (%d recurring, %d exceptions), "
+          "%d loaded ranges, %d index entries, %d pending notifications, "
+          "%d pending purges, about %lld bytes",
+          report.eventCount, report.todoCount, report.journalCount,
+          report.recurringCount, report.exceptionCount,
+          report.loadedRanges.count(), report.indexEntryCount,
+          report.pendingNotificationCount, report.pendingPurgeCount,
+          report.estimatedBytes);
+}
+
+// Purging writes to the storage, don't do it from the
+// observer callback but later, in batches.
+void mKCalWorker::schedulePurge()
+{
+    if (mPendingPurges >= MAX_PENDING_PURGES) {
+        mPurgeTimer->start(0);
+    } else if (mPendingPurges > 0 && !mPurgeTimer->isActive()) {
+        mPurgeTimer->start(PURGE_DELAY);
+    }
+}
+
+void mKCalWorker::purge()
+{
+    mPurgeTimer->stop();
+    for (QHash<QString, KCalendarCore::Incidence::List>::ConstIterator it = mPurgeQueue.constBegin();
+         it != mPurgeQueue.constEnd(); ++it) {
+        mStorage.purgeDeletedIncidences(it.value(), it.key());
+    }
+    mPurgeQueue.clear();
+    mPendingPurges = 0;
 }
 
 void mKCalWorker::runRequest(QOrganizerAbstractRequest *request)
 {
+    Tracer::Span span("runRequest");
+    if (Tracer::isEnabled()) {
+        span.setArg(QStringLiteral("type"), int(request->type()));
+    }
+    QElapsedTimer timer;
+    timer.start();
+    mStorage.resetCalls();
     QOrganizerManager::Error error = QOrganizerManager::NoError;
+    // Real requests always take precedence over prefetching.
+    mPrefetchTimer->stop();
     switch (request->type()) {
     case QOrganizerAbstractRequest::ItemOccurrenceFetchRequest: {
         QOrganizerItemOccurrenceFetchRequest *r = qobject_cast<QOrganizerItemOccurrenceFetchRequest*>(request);
@@ -208,36 +1147,47 @@ void mKCalWorker::runRequest(QOrganizerAbstractRequest *request)
             = itemOccurrences(r->parentItem(), r->startDate(), r->endDate(),
                               r->maxOccurrences(), r->fetchHint(), &error);
         QOrganizerManagerEngine::updateItemOccurrenceFetchRequest(r, items, error, QOrganizerAbstractRequest::FinishedState);
-        return;
+        break;
     }
     case QOrganizerAbstractRequest::ItemFetchRequest: {
         QOrganizerItemFetchRequest *r = qobject_cast<QOrganizerItemFetchRequest*>(request);
         if (r->filter().type() == QOrganizerItemFilter::InvalidFilter) {
             QOrganizerManagerEngine::updateItemFetchRequest(r, QList<QOrganizerItem>(), error, QOrganizerAbstractRequest::FinishedState);
-            return;
+            break;
         }
 
         QList<QOrganizerItem> results
             = items(r->filter(), r->startDate(), r->endDate(),
                     r->maxCount(), r->sorting(), r->fetchHint(), &error);
+        if (Tracer::isEnabled()) {
+            span.setArg(QStringLiteral("items"), results.count());
+        }
+        schedulePrefetch(r->startDate(), r->endDate());
         QOrganizerManagerEngine::updateItemFetchRequest(r, results, error, QOrganizerAbstractRequest::FinishedState);
-        return;
+        break;
     }
     case QOrganizerAbstractRequest::ItemIdFetchRequest: {
         QOrganizerItemIdFetchRequest *r = qobject_cast<QOrganizerItemIdFetchRequest*>(request);
         QList<QOrganizerItemId> ids
             = itemIds(r->filter(), r->startDate(), r->endDate(),
                       r->sorting(), &error);
+        if (Tracer::isEnabled()) {
+            span.setArg(QStringLiteral("items"), ids.count());
+        }
+        schedulePrefetch(r->startDate(), r->endDate());
         QOrganizerManagerEngine::updateItemIdFetchRequest(r, ids, error, QOrganizerAbstractRequest::FinishedState);
-        return;
+        break;
     }
     case QOrganizerAbstractRequest::ItemFetchByIdRequest: {
         QOrganizerItemFetchByIdRequest *r = qobject_cast<QOrganizerItemFetchByIdRequest*>(request);
         QMap<int, QOrganizerManager::Error> errors;
         QList<QOrganizerItem> results
             = items(r->ids(), r->fetchHint(), &errors, &error);
+        if (Tracer::isEnabled()) {
+            span.setArg(QStringLiteral("items"), results.count());
+        }
         QOrganizerManagerEngine::updateItemFetchByIdRequest(r, results, error, errors, QOrganizerAbstractRequest::FinishedState);
-        return;
+        break;
     }
     case QOrganizerAbstractRequest::ItemRemoveRequest: {
         QOrganizerItemRemoveRequest *r = qobject_cast<QOrganizerItemRemoveRequest*>(request);
@@ -245,28 +1195,31 @@ void mKCalWorker::runRequest(QOrganizerAbstractRequest *request)
         QList<QOrganizerItem> items = r->items();
         removeItems(&items, &errors, &error);
         QOrganizerManagerEngine::updateItemRemoveRequest(r, error, errors, QOrganizerAbstractRequest::FinishedState);
-        return;
+        break;
     }
     case QOrganizerAbstractRequest::ItemRemoveByIdRequest: {
         QOrganizerItemRemoveByIdRequest *r = qobject_cast<QOrganizerItemRemoveByIdRequest*>(request);
         QMap<int, QOrganizerManager::Error> errors;
         removeItems(r->itemIds(), &errors, &error);
         QOrganizerManagerEngine::updateItemRemoveByIdRequest(r, error, errors, QOrganizerAbstractRequest::FinishedState);
-        return;
+        break;
     }
     case QOrganizerAbstractRequest::ItemSaveRequest: {
         QOrganizerItemSaveRequest *r = qobject_cast<QOrganizerItemSaveRequest*>(request);
         QMap<int, QOrganizerManager::Error> errors;
         QList<QOrganizerItem> items = r->items();
+        if (Tracer::isEnabled()) {
+            span.setArg(QStringLiteral("items"), items.count());
+        }
         saveItems(&items, r->detailMask(), &errors, &error);
         QOrganizerManagerEngine::updateItemSaveRequest(r, items, error, errors, QOrganizerAbstractRequest::FinishedState);
-        return;
+        break;
     }
     case QOrganizerAbstractRequest::CollectionFetchRequest: {
         QOrganizerCollectionFetchRequest *r = qobject_cast<QOrganizerCollectionFetchRequest*>(request);
         const QList<QOrganizerCollection> results = collections(&error);
         QOrganizerManagerEngine::updateCollectionFetchRequest(r, results, error, QOrganizerAbstractRequest::FinishedState);
-        return;
+        break;
     }
     case QOrganizerAbstractRequest::CollectionSaveRequest: {
         QOrganizerCollectionSaveRequest *r = qobject_cast<QOrganizerCollectionSaveRequest*>(request);
@@ -274,18 +1227,133 @@ void mKCalWorker::runRequest(QOrganizerAbstractRequest *request)
         QList<QOrganizerCollection> collections = r->collections();
         saveCollections(&collections, &errors, &error);
         QOrganizerManagerEngine::updateCollectionSaveRequest(r, collections, error, errors, QOrganizerAbstractRequest::FinishedState);
-        return;
+        break;
     }
     case QOrganizerAbstractRequest::CollectionRemoveRequest: {
         QOrganizerCollectionRemoveRequest *r = qobject_cast<QOrganizerCollectionRemoveRequest*>(request);
         QMap<int, QOrganizerManager::Error> errors;
         removeCollections(r->collectionIds(), &errors, &error);
         QOrganizerManagerEngine::updateCollectionRemoveRequest(r, error, errors, QOrganizerAbstractRequest::FinishedState);
-        return;
+        break;
     }
     default:
         break;
     }
+    if (Tracer::isEnabled()) {
+        const InstrumentedStorage::Breakdown calls = mStorage.calls();
+        for (InstrumentedStorage::Breakdown::ConstIterator it = calls.constBegin();
+             it != calls.constEnd(); ++it) {
+            span.setArg(QString::fromLatin1(it.key()), it->count);
+        }
+    }
+    const qint64 elapsed = timer.elapsed();
+    if (mOptions.slowRequestThreshold > 0 && elapsed >= mOptions.slowRequestThreshold) {
+        logSlowRequest(request, elapsed);
+    }
+    if (!mPrefetchWindows.isEmpty()) {
+        mPrefetchTimer->start();
+    }
+}
+
+static QString describeRange(const QDateTime &start, const QDateTime &end)
+{
+    return QStringLiteral("[%1, %2]").arg(start.toString(Qt::ISODate),
+                                          end.toString(Qt::ISODate));
+}
+
+// One line with what the request asked for and the storage
+// calls it triggered, to spot repeated per item calls.
+void mKCalWorker::logSlowRequest(QOrganizerAbstractRequest *request,
+                                 qint64 elapsed) const
+{
+    QString description;
+    switch (request->type()) {
+    case QOrganizerAbstractRequest::ItemOccurrenceFetchRequest: {
+        QOrganizerItemOccurrenceFetchRequest *r = qobject_cast<QOrganizerItemOccurrenceFetchRequest*>(request);
+        description = QStringLiteral("occurrences of %1 in %2")
+            .arg(QString::fromUtf8(r->parentItem().id().localId()),
+                 describeRange(r->startDate(), r->endDate()));
+        break;
+    }
+    case QOrganizerAbstractRequest::ItemFetchRequest: {
+        QOrganizerItemFetchRequest *r = qobject_cast<QOrganizerItemFetchRequest*>(request);
+        description = QStringLiteral("items, filter type %1, in %2")
+            .arg(int(r->filter().type()))
+            .arg(describeRange(r->startDate(), r->endDate()));
+        break;
+    }
+    case QOrganizerAbstractRequest::ItemIdFetchRequest: {
+        QOrganizerItemIdFetchRequest *r = qobject_cast<QOrganizerItemIdFetchRequest*>(request);
+        description = QStringLiteral("item ids, filter type %1, in %2")
+            .arg(int(r->filter().type()))
+            .arg(describeRange(r->startDate(), r->endDate()));
+        break;
+    }
+    case QOrganizerAbstractRequest::ItemFetchByIdRequest:
+        description = QStringLiteral("%1 items by id")
+            .arg(qobject_cast<QOrganizerItemFetchByIdRequest*>(request)->ids().count());
+        break;
+    case QOrganizerAbstractRequest::ItemSaveRequest:
+        description = QStringLiteral("save of %1 items")
+            .arg(qobject_cast<QOrganizerItemSaveRequest*>(request)->items().count());
+        break;
+    case QOrganizerAbstractRequest::ItemRemoveRequest:
+        description = QStringLiteral("removal of %1 items")
+            .arg(qobject_cast<QOrganizerItemRemoveRequest*>(request)->items().count());
+        break;
+    case QOrganizerAbstractRequest::ItemRemoveByIdRequest:
+        description = QStringLiteral("removal of %1 items by id")
+            .arg(qobject_cast<QOrganizerItemRemoveByIdRequest*>(request)->itemIds().count());
+        break;
+    default:
+        description = QStringLiteral("request type %1").arg(int(request->type()));
+        break;
+    }
+
+    QStringList breakdown;
+    const InstrumentedStorage::Breakdown calls = mStorage.calls();
+    for (InstrumentedStorage::Breakdown::ConstIterator it = calls.constBegin();
+         it != calls.constEnd(); ++it) {
+        breakdown << QStringLiteral("%1 x%2 %3ms").arg(QString::fromLatin1(it.key()))
+            .arg(it->count).arg(it->elapsed / 1000000);
+    }
+    qWarning("mKCal slow request (%lldms): %s; storage: %s", elapsed,
+             qPrintable(description), qPrintable(breakdown.join(QStringLiteral(", "))));
+}
+
+void mKCalWorker::schedulePrefetch(const QDateTime &startDateTime,
+                                   const QDateTime &endDateTime)
+{
+    if (!startDateTime.isValid() || !endDateTime.isValid()) {
+        return;
+    }
+
+    // Next and previous windows of the same length, the next
+    // one being the most likely to be requested.
+    const QDate start = startDateTime.date();
+    const QDate end = endDateTime.date().addDays(1);
+    const qint64 span = start.daysTo(end);
+    if (span <= 0 || span > MAX_PREFETCH_DAYS) {
+        return;
+    }
+    mPrefetchWindows.clear();
+    mPrefetchWindows << QPair<QDate, QDate>(end, end.addDays(span));
+    mPrefetchWindows << QPair<QDate, QDate>(start.addDays(-span), start);
+}
+
+void mKCalWorker::prefetch()
+{
+    if (!mOpened || mPrefetchWindows.isEmpty()) {
+        return;
+    }
+
+    // Load one window at a time, so pending requests
+    // are served between two windows.
+    const QPair<QDate, QDate> window = mPrefetchWindows.takeFirst();
+    loadRange(window.first, window.second);
+    if (!mPrefetchWindows.isEmpty()) {
+        mPrefetchTimer->start();
+    }
 }
 
 static QDateTime itemStartDateTime(const QOrganizerItem &item)
@@ -307,6 +1375,92 @@ static QDateTime itemStartDateTime(const QOrganizerItem &item)
     return QDateTime();
 }
 
+static void sortItems(QList<QOrganizerItem> *items,
+                      const QList<QOrganizerItemSortOrder> &sortOrders)
+{
+    Tracer::Span span("sort");
+    if (Tracer::isEnabled()) {
+        span.setArg(QStringLiteral("items"), items->count());
+    }
+    std::sort(items->begin(), items->end(),
+              [sortOrders] (const QOrganizerItem &item1, const QOrganizerItem &item2) {
+                  int cmp = QOrganizerManagerEngine::compareItem(item1, item2, sortOrders);
+                  if (cmp == 0) {
+                      return itemStartDateTime(item1) < itemStartDateTime(item2);
+                  } else {
+                      return (cmp < 0);
+                  }
+              });
+}
+
+// Recognise "what changed since" queries: an open ended range filter
+// on the last modification date, possibly intersected with other
+// filters, returned in remaining.
+static bool isModifiedSinceFilter(const QOrganizerItemFilter &filter,
+                                  QDateTime *since,
+                                  QOrganizerItemFilter *remaining)
+{
+    if (filter.type() == QOrganizerItemFilter::DetailRangeFilter) {
+        const QOrganizerItemDetailRangeFilter range(filter);
+        if (range.detailType() == QOrganizerItemDetail::TypeTimestamp
+            && range.detailField() == QOrganizerItemTimestamp::FieldLastModified
+            && range.minValue().toDateTime().isValid()
+            && !range.maxValue().isValid()) {
+            *since = range.minValue().toDateTime();
+            *remaining = QOrganizerItemFilter();
+            return true;
+        }
+    } else if (filter.type() == QOrganizerItemFilter::IntersectionFilter) {
+        QList<QOrganizerItemFilter> others;
+        bool found = false;
+        for (const QOrganizerItemFilter &sub : QOrganizerItemIntersectionFilter(filter).filters()) {
+            QOrganizerItemFilter rest;
+            if (!found && isModifiedSinceFilter(sub, since, &rest)
+                && rest.type() == QOrganizerItemFilter::DefaultFilter) {
+                found = true;
+            } else {
+                others.append(sub);
+            }
+        }
+        if (found) {
+            if (others.isEmpty()) {
+                *remaining = QOrganizerItemFilter();
+            } else {
+                QOrganizerItemIntersectionFilter intersection;
+                intersection.setFilters(others);
+                *remaining = intersection;
+            }
+        }
+        return found;
+    }
+    return false;
+}
+
+// Tell if items of the given notebook may match the collection
+// restrictions of filter.
+static bool isInCollections(const QOrganizerItemFilter &filter,
+                            const QString &notebookUid)
+{
+    switch (filter.type()) {
+    case QOrganizerItemFilter::CollectionFilter:
+        for (const QOrganizerCollectionId &id : QOrganizerItemCollectionFilter(filter).collectionIds()) {
+            if (id.localId() == notebookUid.toUtf8()) {
+                return true;
+            }
+        }
+        return false;
+    case QOrganizerItemFilter::IntersectionFilter:
+        for (const QOrganizerItemFilter &sub : QOrganizerItemIntersectionFilter(filter).filters()) {
+            if (!isInCollections(sub, notebookUid)) {
+                return false;
+            }
+        }
+        return true;
+    default:
+        return true;
+    }
+}
+
 QList<QOrganizerItem> mKCalWorker::items(const QList<QOrganizerItemId> &itemIds,
                                          const QOrganizerItemFetchHint &fetchHint,
                                          QMap<int, QOrganizerManager::Error> *errorMap,
@@ -317,7 +1471,7 @@ QList<QOrganizerItem> mKCalWorker::items(const QList<QOrganizerItemId> &itemIds,
         int index = 0;
         for (const QOrganizerItemId &id : itemIds) {
             if (id.managerUri() == managerUri()
-                && mStorage->loadIncidenceInstance(id.localId())) {
+                && mStorage.loadIncidenceInstance(id.localId())) {
                 const QOrganizerItem item = mCalendars->item(id, fetchHint.detailTypesHint());
                 if (!item.isEmpty()) {
                     items.append(item);
@@ -344,19 +1498,20 @@ QList<QOrganizerItem> mKCalWorker::items(const QOrganizerItemFilter &filter,
                                          QOrganizerManager::Error *error)
 {
     QList<QOrganizerItem> items;
-    if (mOpened && mStorage->load(startDateTime.date(), endDateTime.date().addDays(1))) {
+    QDateTime since;
+    QOrganizerItemFilter remaining;
+    if (mOpened && !startDateTime.isValid() && !endDateTime.isValid()
+        && isModifiedSinceFilter(filter, &since, &remaining)) {
+        items = modifiedItems(since, remaining, fetchHint.detailTypesHint(), error);
+        sortItems(&items, sortOrders);
+        if (maxCount > 0 && items.count() > maxCount) {
+            items.erase(items.begin() + maxCount, items.end());
+        }
+    } else if (mOpened && loadRange(startDateTime.date(), endDateTime.date().addDays(1))) {
         items = mCalendars->items(managerUri(), filter,
                                   startDateTime, endDateTime, maxCount,
                                   fetchHint.detailTypesHint());
-        std::sort(items.begin(), items.end(),
-                  [sortOrders] (const QOrganizerItem &item1, const QOrganizerItem &item2) {
-                      int cmp = compareItem(item1, item2, sortOrders);
-                      if (cmp == 0) {
-                          return itemStartDateTime(item1) < itemStartDateTime(item2);
-                      } else {
-                          return (cmp < 0);
-                      }
-                  });
+        sortItems(&items, sortOrders);
     } else {
         *error = QOrganizerManager::PermissionsError;
     }
@@ -364,6 +1519,51 @@ QList<QOrganizerItem> mKCalWorker::items(const QOrganizerItemFilter &filter,
     return items;
 }
 
+// Answer delta queries from the storage modification dates, without
+// loading any date range. Deleted incidences that are not purged yet
+// are returned as tombstones.
+QList<QOrganizerItem> mKCalWorker::modifiedItems(const QDateTime &since,
+                                                 const QOrganizerItemFilter &filter,
+                                                 const QList<QOrganizerItemDetail::DetailType> &details,
+                                                 QOrganizerManager::Error *error)
+{
+    QList<QOrganizerItem> items;
+
+    // Changes are dated when written to the storage.
+    if (mFlushTimer->isActive() && !flush()) {
+        *error = QOrganizerManager::PermissionsError;
+        return items;
+    }
+
+    for (const mKCal::Notebook::Ptr &nb : mStorage.notebooks()) {
+        if (!isInCollections(filter, nb->uid())) {
+            continue;
+        }
+        KCalendarCore::Incidence::List inserted;
+        KCalendarCore::Incidence::List modified;
+        KCalendarCore::Incidence::List deleted;
+        if (!mStorage->insertedIncidences(&inserted, since, nb->uid())
+            || !mStorage->modifiedIncidences(&modified, since, nb->uid())
+            || !mStorage->deletedIncidences(&deleted, since, nb->uid())) {
+            *error = QOrganizerManager::UnspecifiedError;
+            continue;
+        }
+        for (const KCalendarCore::Incidence::Ptr &incidence : inserted + modified) {
+            const QOrganizerItem item = ItemCalendars::toItem(managerUri(), incidence,
+                                                              nb->uid(), details);
+            if (testFilter(filter, item)) {
+                items.append(item);
+            }
+        }
+        for (const KCalendarCore::Incidence::Ptr &incidence : deleted) {
+            items.append(ItemCalendars::toDeletedItem(managerUri(), incidence, nb->uid(),
+                                                      mStorage->incidenceDeletedDate(incidence)));
+        }
+    }
+
+    return items;
+}
+
 QList<QOrganizerItemId> mKCalWorker::itemIds(const QOrganizerItemFilter &filter,
                                              const QDateTime &startDateTime,
                                              const QDateTime &endDateTime,
@@ -371,19 +1571,11 @@ QList<QOrganizerItemId> mKCalWorker::itemIds(const QOrganizerItemFilter &filter,
                                              QOrganizerManager::Error *error)
 {
     QList<QOrganizerItemId> ids;
-    if (mOpened && mStorage->load(startDateTime.date(), endDateTime.date().addDays(1))) {
+    if (mOpened && loadRange(startDateTime.date(), endDateTime.date().addDays(1))) {
         QList<QOrganizerItem> items = mCalendars->items(managerUri(), filter,
                                                         startDateTime, endDateTime,
                                                         0, QList<QOrganizerItemDetail::DetailType>());
-        std::sort(items.begin(), items.end(),
-                  [sortOrders] (const QOrganizerItem &item1, const QOrganizerItem &item2) {
-                      int cmp = compareItem(item1, item2, sortOrders);
-                      if (cmp == 0) {
-                          return itemStartDateTime(item1) < itemStartDateTime(item2);
-                      } else {
-                          return (cmp < 0);
-                      }
-                  });
+        sortItems(&items, sortOrders);
         QSet<QString> localIds;
         for (const QOrganizerItem &item : items) {
             if (!item.id().isNull()) {
@@ -419,7 +1611,7 @@ QList<QOrganizerItem> mKCalWorker::itemOccurrences(const QOrganizerItem &parentI
     QList<QOrganizerItem> items;
     if (mOpened
         && parentItem.id().managerUri() == managerUri()
-        && mStorage->load(parentItem.id().localId())) {
+        && mStorage.load(parentItem.id().localId())) {
         items = mCalendars->occurrences(managerUri(), parentItem,
                                         startDateTime, endDateTime,
                                         maxCount, fetchHint.detailTypesHint());
@@ -434,6 +1626,12 @@ QList<QOrganizerItem> mKCalWorker::itemOccurrences(const QOrganizerItem &parentI
     return items;
 }
 
+static KCalendarCore::Incidence::Ptr prepareIncidence(const QOrganizerItem &item)
+{
+    return item.id().isNull()
+        ? ItemCalendars::newIncidence(item) : KCalendarCore::Incidence::Ptr();
+}
+
 bool mKCalWorker::saveItems(QList<QOrganizerItem> *items,
                             const QList<QOrganizerItemDetail::DetailType> &detailMask,
                             QMap<int, QOrganizerManager::Error> *errorMap,
@@ -441,28 +1639,67 @@ bool mKCalWorker::saveItems(QList<QOrganizerItem> *items,
 {
     *error = QOrganizerManager::NoError;
     if (mOpened) {
+        // Conversion of new items is pure CPU work, do it in
+        // parallel for large saves. Calendar modifications
+        // stay serialized on this thread.
+        QList<KCalendarCore::Incidence::Ptr> prepared;
+        if (items->count() >= MIN_PARALLEL_ITEMS) {
+            prepared = QtConcurrent::blockingMapped<QList<KCalendarCore::Incidence::Ptr>>(*items, prepareIncidence);
+        }
+        KCalendarCore::Incidence::List saved;
         int index = 0;
         for (QOrganizerItem &item : *items) {
             if (item.id().isNull()) {
                 if (item.collectionId().isNull()) {
                     item.setCollectionId(defaultCollectionId());
                 }
-                const QByteArray localId = mCalendars->addItem(item);
+                const QByteArray localId = mCalendars->addItem(item, prepared.value(index));
                 if (localId.isEmpty()) {
                     errorMap->insert(index, QOrganizerManager::InvalidItemTypeError);
                 } else {
                     item.setId(itemId(localId));
+                    saved << mCalendars->instance(localId);
                 }
             } else if (item.id().managerUri() == managerUri()) {
+                const KCalendarCore::Incidence::Ptr previous = mCalendars->instance(item.id().localId());
+                const QString previousUid = previous ? mCalendars->notebook(previous) : QString();
                 if (!mCalendars->updateItem(item, detailMask)) {
                     errorMap->insert(index, QOrganizerManager::DoesNotExistError);
+                } else {
+                    const KCalendarCore::Incidence::Ptr incidence
+                        = mCalendars->instance(item.id().localId());
+                    saved << incidence;
+                    // Moved out of its collection, with the whole series
+                    // that must be journaled too.
+                    if (!previousUid.isEmpty()
+                        && previousUid != mCalendars->notebook(incidence)) {
+                        const KCalendarCore::Incidence::Ptr parent = incidence->hasRecurrenceId()
+                            ? mCalendars->incidence(incidence->uid()) : incidence;
+                        if (parent) {
+                            KCalendarCore::Incidence::List series = mCalendars->instances(parent);
+                            series.prepend(parent);
+                            for (const KCalendarCore::Incidence::Ptr &instance : series) {
+                                if (instance != incidence) {
+                                    saved << instance;
+                                }
+                            }
+                        }
+                        if (mStatistics) {
+                            mStatistics->invalidate(previousUid);
+                            mMovedFromNotebookUids.insert(previousUid);
+                        }
+                    }
                 }
             } else {
                 *error = QOrganizerManager::DoesNotExistError;
             }
             index += 1;
         }
-        if (!mStorage->save()) {
+        if (mOptions.writeBehind && mJournal && journal(saved)) {
+            if (!mFlushTimer->isActive()) {
+                mFlushTimer->start();
+            }
+        } else if (!flush()) {
             *error = QOrganizerManager::PermissionsError;
         }
     } else {
@@ -491,7 +1728,7 @@ bool mKCalWorker::removeItems(const QList<QOrganizerItemId> &itemIds,
             }
             index += 1;
         }
-        if (!mStorage->save()) {
+        if (!flush()) {
             *error = QOrganizerManager::PermissionsError;
         }
     } else {
@@ -521,7 +1758,7 @@ bool mKCalWorker::removeItems(const QList<QOrganizerItem> *items,
             }
             index += 1;
         }
-        if (!mStorage->save()) {
+        if (!flush()) {
             *error = QOrganizerManager::PermissionsError;
         }
     } else {
@@ -532,6 +1769,266 @@ bool mKCalWorker::removeItems(const QList<QOrganizerItem> *items,
         && errorMap->isEmpty();
 }
 
+// Delete at once all items matching filter in the given range,
+// the way itemIds() and removeItems() would do, but without
+// converting the incidences to items when the filter allows it.
+// Deletions and purges are done in one storage transaction when
+// all incidences belong to local notebooks.
+// Return the number of deleted incidences or -1 on error.
+int mKCalWorker::removeMatchingItems(const QOrganizerItemFilter &filter,
+                                     const QDateTime &startDateTime,
+                                     const QDateTime &endDateTime)
+{
+    if (!mOpened
+        || !loadRange(startDateTime.date(), endDateTime.date().addDays(1))) {
+        return -1;
+    }
+
+    const KCalendarCore::Incidence::List doomed
+        = mCalendars->matchingIncidences(managerUri(), filter,
+                                         startDateTime, endDateTime);
+    bool purge = true;
+    QHash<QString, bool> local;
+    int count = 0;
+    for (const KCalendarCore::Incidence::Ptr &incidence : doomed) {
+        const QString notebookUid = mCalendars->notebook(incidence);
+        QHash<QString, bool>::ConstIterator it = local.constFind(notebookUid);
+        if (it == local.constEnd()) {
+            it = local.insert(notebookUid, isLocalNotebook(mStorage->notebook(notebookUid)));
+        }
+        purge = purge && it.value();
+        // Exceptions may already be gone with their parent.
+        if (mCalendars->deleteIncidence(incidence)) {
+            count += 1;
+        }
+    }
+    if (!flush(purge ? mKCal::ExtendedStorage::PurgeDeleted
+               : mKCal::ExtendedStorage::MarkDeleted)) {
+        return -1;
+    }
+
+    return count;
+}
+
+// Reassign the given items to notebookUid in one storage
+// transaction, keeping their ids. Items that don't exist or
+// belong to a read-only notebook are skipped. Return the number
+// of moved items or -1 on error.
+int mKCalWorker::moveItems(const QList<QOrganizerItemId> &itemIds,
+                           const QString &notebookUid)
+{
+    mKCal::Notebook::Ptr nb = mStorage ? mStorage->notebook(notebookUid) : mKCal::Notebook::Ptr();
+    if (!mOpened || !nb || nb->isReadOnly()) {
+        return -1;
+    }
+
+    QHash<QString, bool> writable;
+    QSet<QString> loadedSeries;
+    int count = 0;
+    for (const QOrganizerItemId &id : itemIds) {
+        if (id.managerUri() != managerUri()) {
+            continue;
+        }
+        const QString identifier = QString::fromUtf8(id.localId());
+        KCalendarCore::Incidence::Ptr incidence = mCalendars->instance(identifier);
+        // Most ids are plain uids, loading by uid brings
+        // the whole series in the same query.
+        if (!incidence && mStorage.load(identifier)) {
+            loadedSeries.insert(identifier);
+            incidence = mCalendars->instance(identifier);
+        }
+        if (!incidence && mStorage.loadIncidenceInstance(identifier)) {
+            incidence = mCalendars->instance(identifier);
+        }
+        if (!incidence) {
+            continue;
+        }
+        // The whole series is moved. Series are all loaded with
+        // the first range, otherwise load each one once.
+        if ((incidence->recurs() || incidence->hasRecurrenceId())
+            && mLoadedRanges.isEmpty() && !loadedSeries.contains(incidence->uid())) {
+            if (!mStorage.load(incidence->uid())) {
+                continue;
+            }
+            loadedSeries.insert(incidence->uid());
+        }
+        const QString sourceUid = mCalendars->notebook(incidence);
+        QHash<QString, bool>::ConstIterator it = writable.constFind(sourceUid);
+        if (it == writable.constEnd()) {
+            mKCal::Notebook::Ptr source = mStorage->notebook(sourceUid);
+            it = writable.insert(sourceUid, source && !source->isReadOnly());
+        }
+        if (it.value() && mCalendars->moveIncidence(incidence, notebookUid)) {
+            count += 1;
+            if (mStatistics) {
+                mStatistics->invalidate(sourceUid);
+                mStatistics->invalidate(notebookUid);
+                mMovedFromNotebookUids.insert(sourceUid);
+            }
+        }
+    }
+    if (!flush()) {
+        return -1;
+    }
+
+    return count;
+}
+
+// Parse iCalendar data from device, component by component, and add
+// them to the calendar in notebookUid. Every commitSize components,
+// the pending ones are parsed in a temporary calendar and saved in
+// one storage transaction. Saved incidences that a later range load
+// would bring back are then dropped from memory, so neither the raw
+// data nor the parsed incidences grow with the import size.
+// When a chunk fails, the import stops and is reported incomplete
+// with the number of components already committed.
+ImportResult mKCalWorker::importIcs(QIODevice *device, const QString &notebookUid,
+                                    int commitSize)
+{
+    ImportResult result;
+    if (!mOpened || !device || !mStorage->notebook(notebookUid)) {
+        return result;
+    }
+    if (!device->isOpen() && !device->open(QIODevice::ReadOnly)) {
+        return result;
+    }
+
+    KCalendarCore::ICalFormat format;
+    QByteArray properties;
+    QByteArray timeZones;
+    QByteArray components;
+    QByteArray component;
+    QByteArray *current = &properties;
+    bool isTimeZone = false;
+    int depth = 0;
+    int pending = 0;
+    result.count = 0;
+
+    auto commit = [&] () {
+        QByteArray data("BEGIN:VCALENDAR\r\n");
+        data += properties.isEmpty() ? QByteArray("VERSION:2.0\r\n") : properties;
+        data += timeZones;
+        data += components;
+        data += "END:VCALENDAR\r\n";
+        components.clear();
+        pending = 0;
+
+        KCalendarCore::MemoryCalendar::Ptr chunk(new KCalendarCore::MemoryCalendar(mCalendars->timeZone()));
+        if (!format.fromRawString(chunk, data)) {
+            return false;
+        }
+        // Parents first, exceptions are attached to them.
+        KCalendarCore::Incidence::List incidences = chunk->incidences();
+        std::stable_sort(incidences.begin(), incidences.end(),
+                         [] (const KCalendarCore::Incidence::Ptr &a,
+                             const KCalendarCore::Incidence::Ptr &b) {
+                             return !a->hasRecurrenceId() && b->hasRecurrenceId();
+                         });
+        chunk->close();
+        // Incidences already in the storage are updated in place,
+        // so their row is reused, and moved to the target notebook.
+        KCalendarCore::Incidence::List committed;
+        QSet<QString> loadedUids;
+        for (const KCalendarCore::Incidence::Ptr &incidence : incidences) {
+            if (!loadedUids.contains(incidence->uid())) {
+                mStorage.load(incidence->uid());
+                loadedUids.insert(incidence->uid());
+            }
+            KCalendarCore::Incidence::Ptr existing
+                = mCalendars->incidence(incidence->uid(), incidence->recurrenceId());
+            if (existing && existing->type() == incidence->type()) {
+                const QString previousUid = mCalendars->notebook(existing);
+                if (previousUid != notebookUid) {
+                    if (!mCalendars->moveIncidence(existing, notebookUid)) {
+                        return false;
+                    }
+                    if (mStatistics) {
+                        mStatistics->invalidate(previousUid);
+                        mMovedFromNotebookUids.insert(previousUid);
+                    }
+                }
+                existing->update();
+                *existing = *incidence;
+                existing->updated();
+                committed << existing;
+            } else {
+                if (existing) {
+                    mCalendars->deleteIncidence(existing);
+                }
+                mCalendars->addIncidence(incidence, notebookUid);
+                committed << incidence;
+            }
+        }
+        if (!flush()) {
+            return false;
+        }
+        result.count += incidences.count();
+
+        KCalendarCore::Incidence::List unloaded;
+        for (const KCalendarCore::Incidence::Ptr &incidence : committed) {
+            if (!isInLoadedRange(incidence)) {
+                unloaded << incidence;
+            }
+        }
+        mCalendars->unregisterObserver(mStorage.data());
+        mCalendars->unload(unloaded);
+        mCalendars->registerObserver(mStorage.data());
+        return true;
+    };
+
+    while (!device->atEnd()) {
+        const QByteArray line = device->readLine();
+        if (line.startsWith(' ') || line.startsWith('\t')) {
+            // Folded line, continuing the previous one.
+            current->append(line);
+            continue;
+        }
+        const QByteArray token = line.trimmed().toUpper();
+        if (token.startsWith("BEGIN:")) {
+            depth += 1;
+            if (depth == 2) {
+                isTimeZone = (token == "BEGIN:VTIMEZONE");
+                component.clear();
+                current = &component;
+            }
+            if (depth > 1) {
+                current->append(line);
+            }
+        } else if (token.startsWith("END:")) {
+            if (depth > 1) {
+                current->append(line);
+            }
+            if (depth == 2) {
+                if (isTimeZone) {
+                    timeZones += component;
+                } else {
+                    components += component;
+                    pending += 1;
+                }
+                component.clear();
+                current = &properties;
+                if (pending >= commitSize && !commit()) {
+                    return result;
+                }
+            }
+            depth -= 1;
+        } else if (depth > 0) {
+            current->append(line);
+        }
+    }
+    if (pending > 0 && !commit()) {
+        return result;
+    }
+
+    result.complete = true;
+    return result;
+}
+
+bool mKCalWorker::isOpened() const
+{
+    return mOpened;
+}
+
 QOrganizerCollectionId mKCalWorker::defaultCollectionId() const
 {
     return (mStorage && mStorage->defaultNotebook())
@@ -545,8 +2042,9 @@ QList<QOrganizerCollection> mKCalWorker::collections(QOrganizerManager::Error *e
 
     *error = QOrganizerManager::NoError;
     if (mOpened) {
-        for (const mKCal::Notebook::Ptr &nb : mStorage->notebooks()) {
-            ret.append(toCollection(managerUri(), nb));
+        for (const mKCal::Notebook::Ptr &nb : mStorage.notebooks()) {
+            ret.append(toCollection(managerUri(), nb,
+                                    mStatistics ? &mStatistics->counters(nb) : nullptr));
         }
     } else {
         *error = QOrganizerManager::PermissionsError;
@@ -555,6 +2053,19 @@ QList<QOrganizerCollection> mKCalWorker::collections(QOrganizerManager::Error *e
     return ret;
 }
 
+QList<QOrganizerCollection> mKCalWorker::notebookCollections(const QSet<QString> &notebookUids) const
+{
+    QList<QOrganizerCollection> ret;
+    for (const QString &uid : notebookUids) {
+        const mKCal::Notebook::Ptr nb = mStorage->notebook(uid);
+        if (nb) {
+            ret.append(toCollection(managerUri(), nb,
+                                    mStatistics ? &mStatistics->counters(nb) : nullptr));
+        }
+    }
+    return ret;
+}
+
 bool mKCalWorker::saveCollections(QList<QOrganizerCollection> *collections,
                                   QMap<int, QOrganizerManager::Error> *errors,
                                   QOrganizerManager::Error *error)
@@ -594,6 +2105,9 @@ bool mKCalWorker::saveCollections(QList<QOrganizerCollection> *collections,
             }
         }
         if (!addedIds.isEmpty() || !modifiedIds.isEmpty()) {
+            logNotebookChanges(addedIds, modifiedIds, QStringList());
+            QOrganizerManager::Error refreshError;
+            emit collectionsRefreshed(this->collections(&refreshError));
             emit collectionsUpdated(addedIds, modifiedIds, QStringList());
         }
         if (!added.isEmpty()) {
@@ -646,9 +2160,14 @@ bool mKCalWorker::removeCollections(const QList<QOrganizerCollectionId> &collect
         for (const QOrganizerCollectionId &collectionId : collectionIds) {
             mKCal::Notebook::Ptr nb = mStorage->notebook(collectionId.localId());
             if (nb) {
-                if (!mStorage->deleteNotebook(nb)) {
+                if (!purgeNotebook(nb) || !mStorage->deleteNotebook(nb)) {
                     errors->insert(index, QOrganizerManager::PermissionsError);
                 } else {
+                    // Already purged with the notebook.
+                    mPendingPurges -= mPurgeQueue.take(nb->uid()).count();
+                    if (mStatistics) {
+                        mStatistics->remove(nb->uid());
+                    }
                     ids.prepend(nb->uid());
                     removedIds.prepend(collectionId);
                     mods.prepend(QPair<QOrganizerCollectionId, QOrganizerManager::Operation>(collectionId, QOrganizerManager::Remove));
@@ -659,6 +2178,9 @@ bool mKCalWorker::removeCollections(const QList<QOrganizerCollectionId> &collect
             index += 1;
         }
         if (!ids.isEmpty()) {
+            logNotebookChanges(QStringList(), QStringList(), ids);
+            QOrganizerManager::Error refreshError;
+            emit collectionsRefreshed(collections(&refreshError));
             emit collectionsUpdated(QStringList(), QStringList(), ids);
         }
         if (!removedIds.isEmpty()) {
@@ -674,6 +2196,47 @@ bool mKCalWorker::removeCollections(const QList<QOrganizerCollectionId> &collect
     return (*error == QOrganizerManager::NoError) && errors->isEmpty();
 }
 
+// Delete the content of notebook by chunks, instead of in the single
+// long transaction of deleteNotebook(), reporting the progress. The
+// progress reaches the engines while they wait for an asynchronous
+// collection removal request, not during a blocking removeCollection().
+bool mKCalWorker::purgeNotebook(const mKCal::Notebook::Ptr &notebook)
+{
+    // Pending changes are saved and notified on their own,
+    // the chunks only hold the deletions.
+    if (mFlushTimer->isActive() && !flush()) {
+        return false;
+    }
+    if (!mStorage.loadNotebookIncidences(notebook->uid())) {
+        return false;
+    }
+    KCalendarCore::Incidence::List incidences = mCalendars->incidences(notebook->uid());
+    // Exceptions first, they may go with their parent otherwise.
+    std::stable_partition(incidences.begin(), incidences.end(),
+                          [] (const KCalendarCore::Incidence::Ptr &incidence) {
+                              return incidence->hasRecurrenceId();
+                          });
+
+    const int total = incidences.count();
+    int removed = 0;
+    bool ok = true;
+    mRemovingNotebookUid = notebook->uid();
+    for (const KCalendarCore::Incidence::Ptr &incidence : incidences) {
+        mCalendars->deleteIncidence(incidence);
+        removed += 1;
+        if (removed % NOTEBOOK_REMOVAL_CHUNK == 0 || removed == total) {
+            if (!flush(mKCal::ExtendedStorage::PurgeDeleted)) {
+                ok = false;
+                break;
+            }
+            emit collectionRemovalProgress(notebook->uid(), removed, total);
+        }
+    }
+    mRemovingNotebookUid.clear();
+
+    return ok;
+}
+
 bool mKCalWorker::removeCollection(const QOrganizerCollectionId &collectionId,
                                    QOrganizerManager::Error *error)
 {
@@ -36,11 +36,104 @@
 #include <QSharedPointer>
 
 #include <QtOrganizer/QOrganizerManagerEngine>
+#include <QtOrganizer/QOrganizerItemType>
 
 #include <sqlitestorage.h>
 #include <extendedstorageobserver.h>
 
 #include "itemcalendars.h"
+#include "changelog.h"
+#include "instrumentedstorage.h"
+
+class QTimer;
+class QIODevice;
+class ChangeJournal;
+class NotebookStatistics;
+
+struct mKCalOptions
+{
+    // When set, saved items are journaled and the request completes
+    // immediately, the storage being written after flushInterval ms.
+    bool writeBehind = false;
+    int flushInterval = 1000;
+    // Item changes happening within this window, in ms, are
+    // merged and notified at once at its end. 0 to disable.
+    int notificationWindow = 0;
+    // Chrome trace-event file recording request spans, if set.
+    QString traceFile;
+    // Log the memory report every interval ms. 0 to disable.
+    int memoryReportInterval = 0;
+    // Log the requests running longer than this, in ms,
+    // with their storage calls. 0 to disable.
+    int slowRequestThreshold = 0;
+    // When set, the engine is created before the storage is
+    // opened, requests being queued until it is ready.
+    bool asyncOpen = false;
+};
+Q_DECLARE_METATYPE(mKCalOptions)
+
+// Content of the worker in-memory calendar and caches.
+struct MemoryReport
+{
+    int eventCount = 0;
+    int todoCount = 0;
+    int journalCount = 0;
+    int recurringCount = 0;
+    int exceptionCount = 0;
+    // Merged date ranges loaded from the storage.
+    QList<QPair<QDate, QDate>> loadedRanges;
+    int indexEntryCount = 0;
+    int pendingNotificationCount = 0;
+    int pendingPurgeCount = 0;
+    // Engines sharing the worker.
+    int clientCount = 0;
+    // Rough estimate of the incidence data, in bytes.
+    qint64 estimatedBytes = 0;
+};
+Q_DECLARE_METATYPE(MemoryReport)
+
+// Outcome of an iCalendar import, the committed items
+// being counted even when a later chunk failed.
+struct ImportResult
+{
+    // -1 when nothing could be imported.
+    int count = -1;
+    bool complete = false;
+};
+Q_DECLARE_METATYPE(ImportResult)
+
+// Item changes of one notification, built once on the worker
+// thread and shared read-only with the engine.
+struct ItemChangeSet
+{
+    // Changed item ids, with the detail types that changed
+    // for all of them, an empty list meaning any detail.
+    typedef QPair<QList<QtOrganizer::QOrganizerItemId>,
+                  QList<QtOrganizer::QOrganizerItemDetail::DetailType>> DetailChanges;
+
+    QList<QtOrganizer::QOrganizerItemId> added;
+    QList<QtOrganizer::QOrganizerItemId> changed;
+    QList<DetailChanges> changedDetails;
+    QList<QtOrganizer::QOrganizerItemId> removed;
+    QList<QPair<QtOrganizer::QOrganizerItemId, QtOrganizer::QOrganizerManager::Operation>> operations;
+    // Engines these changes are for, when the worker is shared.
+    QSet<QObject*> clients;
+};
+typedef QSharedPointer<const ItemChangeSet> ItemChangeSetPtr;
+Q_DECLARE_METATYPE(ItemChangeSetPtr)
+
+// Interest of a client in some items only. Empty lists
+// and invalid dates don't restrict the notified items.
+struct ItemSubscription
+{
+    QList<QtOrganizer::QOrganizerCollectionId> collectionIds;
+    QDateTime startDateTime;
+    QDateTime endDateTime;
+    QList<QtOrganizer::QOrganizerItemType::ItemType> itemTypes;
+    // Engine owning the subscription, when the worker is shared.
+    QObject *client = nullptr;
+};
+Q_DECLARE_METATYPE(ItemSubscription)
 
 class mKCalWorker : public QtOrganizer::QOrganizerManagerEngine, public mKCal::ExtendedStorageObserver
 {
@@ -54,18 +147,34 @@ public:
     QMap<QString, QString> managerParameters() const override;
 
 public slots:
-    bool init(const QTimeZone &timeZone, const QString &databaseName);
+    bool init(const QTimeZone &timeZone, const QString &databaseName,
+              const mKCalOptions &options, QObject *client);
+    bool isOpened() const;
     void runRequest(QtOrganizer::QOrganizerAbstractRequest *request);
     QtOrganizer::QOrganizerCollectionId defaultCollectionId() const override;
+    ImportResult importIcs(QIODevice *device, const QString &notebookUid, int commitSize);
+    ChangeLog::Feed changesSince(qint64 sequence);
+    MemoryReport memoryReport() const;
+    int subscribe(const ItemSubscription &subscription);
+    void unsubscribe(int subscriptionId);
+    void detach(QObject *client);
+    int moveItems(const QList<QtOrganizer::QOrganizerItemId> &itemIds,
+                  const QString &notebookUid);
+    int removeMatchingItems(const QtOrganizer::QOrganizerItemFilter &filter,
+                            const QDateTime &startDateTime,
+                            const QDateTime &endDateTime);
 
 signals:
     void defaultCollectionIdChanged(const QString &id);
-    void itemsUpdated(const QStringList &added,
-                      const QStringList &modified,
-                      const QStringList &deleted);
+    void itemsUpdated(const ItemChangeSetPtr &changes);
     void collectionsUpdated(const QStringList &added,
                             const QStringList &modified,
                             const QStringList &deleted);
+    void collectionsRefreshed(const QList<QtOrganizer::QOrganizerCollection> &collections);
+    // Only the collections whose statistics changed.
+    void collectionStatisticsChanged(const QList<QtOrganizer::QOrganizerCollection> &collections);
+    void collectionRemovalProgress(const QString &notebookUid, int removed, int total);
+    void initialised(bool opened);
 
 private:
     QList<QtOrganizer::QOrganizerItem>
@@ -80,6 +189,11 @@ private:
               const QList<QtOrganizer::QOrganizerItemSortOrder> &sortOrders,
               const QtOrganizer::QOrganizerItemFetchHint &fetchHint,
               QtOrganizer::QOrganizerManager::Error *error) override;
+    QList<QtOrganizer::QOrganizerItem>
+        modifiedItems(const QDateTime &since,
+                      const QtOrganizer::QOrganizerItemFilter &filter,
+                      const QList<QtOrganizer::QOrganizerItemDetail::DetailType> &details,
+                      QtOrganizer::QOrganizerManager::Error *error);
     QList<QtOrganizer::QOrganizerItemId>
         itemIds(const QtOrganizer::QOrganizerItemFilter &filter,
                 const QDateTime &startDateTime,
@@ -116,6 +230,57 @@ private:
                            QMap<int, QtOrganizer::QOrganizerManager::Error> *errors,
                            QtOrganizer::QOrganizerManager::Error *error);
 
+    bool flush(mKCal::ExtendedStorage::DeleteAction deleteAction = mKCal::ExtendedStorage::MarkDeleted);
+    bool journal(const KCalendarCore::Incidence::List &incidences);
+    bool replayJournal(const ChangeJournal &journal);
+    void replayJournals();
+
+    void schedulePurge();
+    void purge();
+
+    void schedulePrefetch(const QDateTime &startDateTime,
+                          const QDateTime &endDateTime);
+    void prefetch();
+
+    ChangeLog::Change logChange(const KCalendarCore::Incidence::Ptr &incidence,
+                                ChangeLog::Operation operation) const;
+    void logNotebookChanges(const QStringList &addedUids,
+                            const QStringList &modifiedUids,
+                            const QStringList &removedUids);
+    void logExternalChanges(const QList<ChangeLog::Change> &changes, bool complete);
+    bool isNotified(const KCalendarCore::Incidence::Ptr &incidence,
+                    const QString &notebookUid,
+                    bool anyWindow = false);
+    QList<QtOrganizer::QOrganizerCollection> notebookCollections(const QSet<QString> &notebookUids) const;
+    bool loadRange(const QDate &start, const QDate &end);
+    bool isInLoadedRange(const KCalendarCore::Incidence::Ptr &incidence) const;
+    void logMemoryReport() const;
+    void logSlowRequest(QtOrganizer::QOrganizerAbstractRequest *request,
+                        qint64 elapsed) const;
+    bool purgeNotebook(const mKCal::Notebook::Ptr &notebook);
+    bool reloadExternalChanges(QStringList *addedIds,
+                               QStringList *modifiedIds,
+                               QStringList *removedIds,
+                               QSet<QString> *notebookUids,
+                               QList<ChangeLog::Change> *changes);
+    void notifyItemsUpdated(const QStringList &addedIds,
+                            const QStringList &modifiedIds,
+                            const QStringList &removedIds,
+                            const QHash<QString, QList<QtOrganizer::QOrganizerItemDetail::DetailType>> &details);
+    void emitChangeSet(const QStringList &addedIds,
+                       const QStringList &modifiedIds,
+                       const QStringList &removedIds,
+                       const QHash<QString, QList<QtOrganizer::QOrganizerItemDetail::DetailType>> &details,
+                       const QSet<QObject*> &clients);
+    void coalesce(const QString &id,
+                  QtOrganizer::QOrganizerManager::Operation operation,
+                  const QList<QtOrganizer::QOrganizerItemDetail::DetailType> &details = QList<QtOrganizer::QOrganizerItemDetail::DetailType>());
+    void emitPendingChanges();
+    void emitItemsUpdated(const QStringList &addedIds,
+                          const QStringList &modifiedIds,
+                          const QStringList &removedIds,
+                          const QHash<QString, QList<QtOrganizer::QOrganizerItemDetail::DetailType>> &details);
+
     void storageModified(mKCal::ExtendedStorage *storage, const QString &info) override;
     void storageUpdated(mKCal::ExtendedStorage *storage,
                         const KCalendarCore::Incidence::List &added,
@@ -123,9 +288,45 @@ private:
                         const KCalendarCore::Incidence::List &deleted) override;
 
     QSharedPointer<ItemCalendars> mCalendars;
-    mKCal::SqliteStorage::Ptr mStorage;
+    InstrumentedStorage mStorage;
     bool mOpened = false;
     QString mDefaultNotebookUid;
+    QTimer *mPrefetchTimer;
+    QList<QPair<QDate, QDate>> mPrefetchWindows;
+    mKCalOptions mOptions;
+    ChangeJournal *mJournal = nullptr;
+    ChangeLog *mChangeLog = nullptr;
+    NotebookStatistics *mStatistics = nullptr;
+    // Notebooks that items were moved out of, since the last
+    // storage update.
+    QSet<QString> mMovedFromNotebookUids;
+    // Date of the last look for changes done by other processes.
+    QDateTime mLastExternalSync;
+    // Last change log sequence checked for external changes.
+    qint64 mExternalLogSequence = 0;
+    QSet<QString> mKnownNotebookUids;
+    QHash<int, ItemSubscription> mSubscriptions;
+    int mLastSubscriptionId = 0;
+    // Engines using this worker and how many subscriptions
+    // restrict the notifications of each of them.
+    QSet<QObject*> mClients;
+    QHash<QObject*, int> mSubscribedClients;
+    // Subscribed engines to notify of each changed item.
+    QHash<QString, QSet<QObject*>> mRecipients;
+    QTimer *mFlushTimer;
+    // Series with journaled changes, not saved yet.
+    QSet<QString> mUnflushedUids;
+    bool mPurged = false;
+    QString mRemovingNotebookUid;
+    QList<QPair<qint64, qint64>> mLoadedRanges;
+    QTimer *mMemoryReportTimer;
+    QTimer *mPurgeTimer;
+    QHash<QString, KCalendarCore::Incidence::List> mPurgeQueue;
+    int mPendingPurges = 0;
+    QTimer *mNotificationTimer;
+    QHash<QString, QtOrganizer::QOrganizerManager::Operation> mPendingChanges;
+    QStringList mPendingOrder;
+    QHash<QString, QList<QtOrganizer::QOrganizerItemDetail::DetailType>> mPendingDetails;
 };
 
 #endif
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2024 Damien Caliste <dcaliste@free.fr>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "notebookstatistics.h"
+
+#include <QSqlQuery>
+#include <QVariant>
+
+NotebookStatistics::NotebookStatistics(const QString &databaseName)
+    : mConnectionName(QStringLiteral("mkcal-statistics-%1").arg(quintptr(this)))
+{
+    mDatabase = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), mConnectionName);
+    mDatabase.setDatabaseName(databaseName);
+    mDatabase.setConnectOptions(QStringLiteral("QSQLITE_OPEN_READONLY"));
+}
+
+NotebookStatistics::~NotebookStatistics()
+{
+    mDatabase.close();
+    mDatabase = QSqlDatabase();
+    QSqlDatabase::removeDatabase(mConnectionName);
+}
+
+bool NotebookStatistics::open()
+{
+    return mDatabase.open();
+}
+
+static QDateTime endDate(const KCalendarCore::Incidence::Ptr &incidence)
+{
+    const QDateTime end = incidence->dateTime(KCalendarCore::Incidence::RoleEnd);
+    return end.isValid() ? end : incidence->dtStart();
+}
+
+void NotebookStatistics::added(const QString &notebookUid,
+                               const KCalendarCore::Incidence::Ptr &incidence)
+{
+    QHash<QString, Counters>::Iterator it = mCounters.find(notebookUid);
+    if (it == mCounters.end() || it->stale) {
+        return;
+    }
+    it->itemCount += 1;
+    const QDateTime start = incidence->dtStart();
+    if (start.isValid() && (!it->earliestDate.isValid() || start < it->earliestDate)) {
+        it->earliestDate = start;
+    }
+    const QDateTime end = endDate(incidence);
+    if (end.isValid() && (!it->latestDate.isValid() || end > it->latestDate)) {
+        it->latestDate = end;
+    }
+    if (it->syncDate.isValid()) {
+        it->pendingUids.insert(incidence->uid());
+    }
+}
+
+void NotebookStatistics::modified(const QString &notebookUid,
+                                  const KCalendarCore::Incidence::Ptr &incidence,
+                                  bool datesChanged)
+{
+    QHash<QString, Counters>::Iterator it = mCounters.find(notebookUid);
+    if (it == mCounters.end() || it->stale) {
+        return;
+    }
+    // The previous dates may have been the bounds.
+    if (datesChanged) {
+        it->stale = true;
+    } else if (it->syncDate.isValid()) {
+        it->pendingUids.insert(incidence->uid());
+    }
+}
+
+void NotebookStatistics::removed(const QString &notebookUid,
+                                 const KCalendarCore::Incidence::Ptr &incidence)
+{
+    QHash<QString, Counters>::Iterator it = mCounters.find(notebookUid);
+    if (it == mCounters.end() || it->stale) {
+        return;
+    }
+    if (incidence->dtStart() == it->earliestDate
+        || endDate(incidence) == it->latestDate) {
+        it->stale = true;
+        return;
+    }
+    it->itemCount -= 1;
+    if (it->syncDate.isValid()) {
+        it->pendingUids.insert(incidence->uid());
+    }
+}
+
+void NotebookStatistics::invalidate(const QString &notebookUid)
+{
+    QHash<QString, Counters>::Iterator it = mCounters.find(notebookUid);
+    if (it != mCounters.end()) {
+        it->stale = true;
+    }
+}
+
+void NotebookStatistics::invalidateAll()
+{
+    for (Counters &counters : mCounters) {
+        counters.stale = true;
+    }
+}
+
+void NotebookStatistics::remove(const QString &notebookUid)
+{
+    mCounters.remove(notebookUid);
+}
+
+// Return the counters of notebook, reading them from the
+// database only when they cannot be maintained anymore.
+const NotebookStatistics::Counters &NotebookStatistics::counters(const mKCal::Notebook::Ptr &notebook)
+{
+    Counters &counters = mCounters[notebook->uid()];
+    if (counters.stale || counters.syncDate != notebook->syncDate()) {
+        counters.syncDate = notebook->syncDate();
+        counters.stale = !load(notebook->uid(), &counters);
+    }
+    return counters;
+}
+
+// Storage dates are stored as seconds since epoch in the
+// Components table of mKCal, 0 meaning no date.
+bool NotebookStatistics::load(const QString &notebookUid, Counters *counters)
+{
+    QSqlQuery query(mDatabase);
+    query.prepare(QStringLiteral("SELECT COUNT(*), MIN(NULLIF(DateStart, 0)), "
+                                 "MAX(MAX(DateStart, DateEndDue)) FROM Components "
+                                 "WHERE Notebook = :notebook AND DateDeleted = 0"));
+    query.bindValue(QStringLiteral(":notebook"), notebookUid);
+    if (!query.exec() || !query.next()) {
+        return false;
+    }
+    counters->itemCount = query.value(0).toInt();
+    counters->earliestDate = query.value(1).isNull() ? QDateTime()
+        : QDateTime::fromSecsSinceEpoch(query.value(1).toLongLong(), Qt::UTC);
+    counters->latestDate = query.value(2).isNull() || query.value(2).toLongLong() == 0 ? QDateTime()
+        : QDateTime::fromSecsSinceEpoch(query.value(2).toLongLong(), Qt::UTC);
+
+    counters->pendingUids.clear();
+    if (counters->syncDate.isValid()) {
+        query.prepare(QStringLiteral("SELECT DISTINCT UID FROM Components "
+                                     "WHERE Notebook = :notebook AND (DateCreated > :created "
+                                     "OR DateLastModified > :modified OR DateDeleted > :deleted)"));
+        const qint64 since = counters->syncDate.toSecsSinceEpoch();
+        query.bindValue(QStringLiteral(":notebook"), notebookUid);
+        query.bindValue(QStringLiteral(":created"), since);
+        query.bindValue(QStringLiteral(":modified"), since);
+        query.bindValue(QStringLiteral(":deleted"), since);
+        if (!query.exec()) {
+            return false;
+        }
+        while (query.next()) {
+            counters->pendingUids.insert(query.value(0).toString());
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2024 Damien Caliste <dcaliste@free.fr>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef NOTEBOOKSTATISTICS_H
+#define NOTEBOOKSTATISTICS_H
+
+#include <QString>
+#include <QDateTime>
+#include <QHash>
+#include <QSet>
+#include <QSqlDatabase>
+
+#include <KCalendarCore/Incidence>
+
+#include <notebook.h>
+
+// Per notebook counters, computed once from the database and then
+// maintained from the incidence changes seen by the worker.
+// Dates are the ones of the incidences, recurrences are not expanded.
+class NotebookStatistics
+{
+public:
+    struct Counters
+    {
+        int itemCount = 0;
+        QDateTime earliestDate;
+        QDateTime latestDate;
+        // Series changed since the notebook sync date.
+        QSet<QString> pendingUids;
+        QDateTime syncDate;
+        bool stale = true;
+    };
+
+    NotebookStatistics(const QString &databaseName);
+    ~NotebookStatistics();
+
+    bool open();
+
+    void added(const QString &notebookUid,
+               const KCalendarCore::Incidence::Ptr &incidence);
+    void modified(const QString &notebookUid,
+                  const KCalendarCore::Incidence::Ptr &incidence,
+                  bool datesChanged);
+    void removed(const QString &notebookUid,
+                 const KCalendarCore::Incidence::Ptr &incidence);
+
+    void invalidate(const QString &notebookUid);
+    void invalidateAll();
+    void remove(const QString &notebookUid);
+
+    const Counters &counters(const mKCal::Notebook::Ptr &notebook);
+
+private:
+    bool load(const QString &notebookUid, Counters *counters);
+
+    QString mConnectionName;
+    QSqlDatabase mDatabase;
+    QHash<QString, Counters> mCounters;
+};
+
+#endif
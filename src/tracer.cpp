@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2024 Damien Caliste <dcaliste@free.fr>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "tracer.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QThread>
+#include <QCoreApplication>
+
+// Events are flushed to the file by batches of this size.
+static const int FLUSH_EVENTS = 64;
+
+struct TraceFile
+{
+    QMutex mutex;
+    QFile file;
+    QElapsedTimer clock;
+    int pending = 0;
+};
+Q_GLOBAL_STATIC(TraceFile, traceFile)
+static QAtomicInt traceEnabled;
+
+bool Tracer::open(const QString &fileName)
+{
+    TraceFile *trace = traceFile();
+    QMutexLocker lock(&trace->mutex);
+    if (trace->file.isOpen()) {
+        return true;
+    }
+    trace->file.setFileName(fileName);
+    if (!trace->file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    // The closing bracket is optional for trace viewers,
+    // so the file stays readable after a crash.
+    trace->file.write("[\n");
+    trace->clock.start();
+    traceEnabled.storeRelease(1);
+    return true;
+}
+
+bool Tracer::isEnabled()
+{
+    return traceEnabled.loadAcquire();
+}
+
+static qint64 now()
+{
+    return traceFile()->clock.nsecsElapsed() / 1000;
+}
+
+static void write(const char *name, const char *phase, qint64 timestamp,
+                  const QJsonObject &args, qint64 duration = -1,
+                  const void *id = nullptr)
+{
+    QJsonObject event;
+    event.insert(QStringLiteral("name"), QString::fromLatin1(name));
+    event.insert(QStringLiteral("cat"), QStringLiteral("mkcal"));
+    event.insert(QStringLiteral("ph"), QString::fromLatin1(phase));
+    event.insert(QStringLiteral("ts"), timestamp);
+    if (duration >= 0) {
+        event.insert(QStringLiteral("dur"), duration);
+    }
+    if (id) {
+        event.insert(QStringLiteral("id"), QString::number(quintptr(id), 16));
+    }
+    event.insert(QStringLiteral("pid"), QCoreApplication::applicationPid());
+    event.insert(QStringLiteral("tid"), qint64(quintptr(QThread::currentThreadId())));
+    if (!args.isEmpty()) {
+        event.insert(QStringLiteral("args"), args);
+    }
+    const QByteArray data = QJsonDocument(event).toJson(QJsonDocument::Compact);
+
+    TraceFile *trace = traceFile();
+    QMutexLocker lock(&trace->mutex);
+    trace->file.write(data);
+    trace->file.write(",\n");
+    trace->pending += 1;
+    if (trace->pending >= FLUSH_EVENTS) {
+        trace->file.flush();
+        trace->pending = 0;
+    }
+}
+
+void Tracer::asyncBegin(const char *name, const void *id, const QJsonObject &args)
+{
+    if (isEnabled()) {
+        write(name, "b", now(), args, -1, id);
+    }
+}
+
+void Tracer::asyncEnd(const char *name, const void *id, const QJsonObject &args)
+{
+    if (isEnabled()) {
+        write(name, "e", now(), args, -1, id);
+    }
+}
+
+Tracer::Span::Span(const char *name)
+    : mName(name)
+    , mStart(isEnabled() ? now() : -1)
+{
+}
+
+Tracer::Span::~Span()
+{
+    if (mStart >= 0) {
+        write(mName, "X", mStart, mArgs, now() - mStart);
+    }
+}
+
+void Tracer::Span::setArg(const QString &key, const QJsonValue &value)
+{
+    if (mStart >= 0) {
+        mArgs.insert(key, value);
+    }
+}
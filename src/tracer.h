@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2024 Damien Caliste <dcaliste@free.fr>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QJsonObject>
+
+// Opt-in recording of timed spans, from any thread, in the Chrome
+// trace-event JSON format to be opened in a trace viewer. When no
+// trace file is open, spans cost one atomic read.
+class Tracer
+{
+public:
+    static bool open(const QString &fileName);
+    static bool isEnabled();
+
+    // Spans not bound to a scope, like the time a request
+    // spends queued, matched by name and id.
+    static void asyncBegin(const char *name, const void *id,
+                           const QJsonObject &args = QJsonObject());
+    static void asyncEnd(const char *name, const void *id,
+                         const QJsonObject &args = QJsonObject());
+
+    class Span
+    {
+    public:
+        Span(const char *name);
+        ~Span();
+
+        void setArg(const QString &key, const QJsonValue &value);
+
+    private:
+        const char *mName;
+        qint64 mStart;
+        QJsonObject mArgs;
+    };
+};
+
+#endif
@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2024 Damien Caliste <dcaliste@free.fr>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include <QObject>
+#include <QTest>
+#include <QString>
+#include <QTemporaryDir>
+
+#include <QOrganizerManager>
+#include <QOrganizerEvent>
+#include <QOrganizerItemFetchHint>
+
+#include <extendedcalendar.h>
+#include <sqlitestorage.h>
+
+using namespace QtOrganizer;
+
+// Size of the synthetic database, overridable from the environment.
+static int parameter(const char *name, int defaultValue)
+{
+    bool ok;
+    const int value = qEnvironmentVariableIntValue(name, &ok);
+    return ok && value >= 0 ? value : defaultValue;
+}
+
+// Deterministic pseudo-random numbers, so runs are comparable.
+static quint32 nextRandom(quint32 *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 16) & 0x7fff;
+}
+
+class tst_bench: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void benchMonthFetch();
+    void benchYearFetch();
+    void benchMonthFetchCold();
+    void benchYearFetchCold();
+    void benchItemIds();
+    void benchItemOccurrences();
+    void benchFetchById();
+    void benchCollections();
+    void benchBulkSave();
+    void benchBulkRemove();
+
+private:
+    void generate(const QString &databaseName);
+    QList<QOrganizerItem> newItems() const;
+
+    QTemporaryDir mDir;
+    QMap<QString, QString> mParameters;
+    QOrganizerManager *mManager = nullptr;
+    QList<QOrganizerItemId> mIds;
+    QOrganizerItem mRecurringItem;
+    const QDateTime mOrigin = QDateTime(QDate(2024, 1, 1), QTime(0, 0), Qt::UTC);
+};
+
+// Write N notebooks holding M events in total, spread over one year.
+// A share of them recur weekly with one exception each, some have
+// attendees and all have a reminder.
+void tst_bench::generate(const QString &databaseName)
+{
+    const int notebookCount = qMax(1, parameter("BENCH_NOTEBOOKS", 4));
+    const int eventCount = parameter("BENCH_EVENTS", 5000);
+    const int recurringShare = parameter("BENCH_RECURRING", 10);
+    const int attendeeShare = parameter("BENCH_ATTENDEES", 30);
+
+    mKCal::ExtendedCalendar::Ptr calendar(new mKCal::ExtendedCalendar(QTimeZone::utc()));
+    mKCal::ExtendedStorage::Ptr storage(new mKCal::SqliteStorage(calendar, databaseName));
+    QVERIFY(storage->open());
+
+    QStringList notebookUids;
+    for (int i = 0; i < notebookCount; i++) {
+        mKCal::Notebook::Ptr nb(new mKCal::Notebook(QStringLiteral("Notebook %1").arg(i),
+                                                    QString()));
+        QVERIFY(storage->addNotebook(nb));
+        notebookUids << nb->uid();
+    }
+
+    quint32 state = 42;
+    for (int i = 0; i < eventCount; i++) {
+        KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+        event->setSummary(QStringLiteral("Event %1").arg(i));
+        event->setLocation(QStringLiteral("Room %1").arg(nextRandom(&state) % 20));
+        event->setDtStart(mOrigin.addSecs(qint64(nextRandom(&state) % 365) * 86400
+                                          + (8 + nextRandom(&state) % 10) * 3600));
+        event->setDtEnd(event->dtStart().addSecs(1800 * (1 + nextRandom(&state) % 4)));
+
+        KCalendarCore::Alarm::Ptr alarm = event->newAlarm();
+        alarm->setDisplayAlarm(event->summary());
+        alarm->setStartOffset(KCalendarCore::Duration(-15 * 60));
+        alarm->setEnabled(true);
+
+        if (int(nextRandom(&state) % 100) < attendeeShare) {
+            for (int j = 0; j < 3; j++) {
+                event->addAttendee(KCalendarCore::Attendee(QStringLiteral("Attendee %1").arg(j),
+                                                           QStringLiteral("attendee%1@example.org").arg(j)));
+            }
+        }
+
+        const QString notebookUid = notebookUids.at(i % notebookUids.count());
+        const bool recurring = int(nextRandom(&state) % 100) < recurringShare;
+        if (recurring) {
+            event->recurrence()->setWeekly(1);
+            event->recurrence()->setDuration(52);
+        }
+        QVERIFY(calendar->addEvent(event, notebookUid));
+        if (recurring) {
+            const QDateTime recurrenceId = event->dtStart().addDays(14);
+            KCalendarCore::Incidence::Ptr exception
+                = KCalendarCore::Calendar::createException(event, recurrenceId);
+            exception->setDtStart(recurrenceId.addSecs(3600));
+            exception.staticCast<KCalendarCore::Event>()->setDtEnd(
+                event->dtEnd().addDays(14).addSecs(3600));
+            exception->setSummary(event->summary() + QStringLiteral(" (moved)"));
+            QVERIFY(calendar->addIncidence(exception, notebookUid));
+        }
+
+        if ((i + 1) % 1000 == 0) {
+            QVERIFY(storage->save());
+        }
+    }
+    QVERIFY(storage->save());
+    storage->close();
+}
+
+void tst_bench::initTestCase()
+{
+    QVERIFY(mDir.isValid());
+    const QString db = mDir.filePath(QStringLiteral("bench.db"));
+    generate(db);
+    if (QTest::currentTestFailed()) {
+        return;
+    }
+
+    mParameters.insert(QStringLiteral("databaseName"), db);
+    mManager = new QOrganizerManager(QString::fromLatin1("mkcal"), mParameters);
+    QCOMPARE(mManager->error(), QOrganizerManager::NoError);
+
+    mIds = mManager->itemIds(mOrigin, mOrigin.addYears(1));
+    QVERIFY(!mIds.isEmpty());
+    for (const QOrganizerItem &item : mManager->items(mIds.mid(0, 500))) {
+        if (!item.details(QOrganizerItemDetail::TypeRecurrence).isEmpty()) {
+            mRecurringItem = item;
+            break;
+        }
+    }
+}
+
+void tst_bench::cleanupTestCase()
+{
+    delete mManager;
+}
+
+void tst_bench::benchMonthFetch()
+{
+    const QDateTime start = mOrigin.addMonths(5);
+    QBENCHMARK {
+        mManager->items(start, start.addMonths(1));
+    }
+}
+
+void tst_bench::benchYearFetch()
+{
+    QBENCHMARK {
+        mManager->items(mOrigin, mOrigin.addYears(1));
+    }
+}
+
+// Engines on the same database share their worker, the warm one
+// is closed so each iteration opens the storage with an empty cache.
+void tst_bench::benchMonthFetchCold()
+{
+    delete mManager;
+    const QDateTime start = mOrigin.addMonths(5);
+    QBENCHMARK {
+        QOrganizerManager manager(QString::fromLatin1("mkcal"), mParameters);
+        manager.items(start, start.addMonths(1));
+    }
+    mManager = new QOrganizerManager(QString::fromLatin1("mkcal"), mParameters);
+}
+
+void tst_bench::benchYearFetchCold()
+{
+    delete mManager;
+    QBENCHMARK {
+        QOrganizerManager manager(QString::fromLatin1("mkcal"), mParameters);
+        manager.items(mOrigin, mOrigin.addYears(1));
+    }
+    mManager = new QOrganizerManager(QString::fromLatin1("mkcal"), mParameters);
+}
+
+void tst_bench::benchItemIds()
+{
+    QBENCHMARK {
+        mManager->itemIds(mOrigin, mOrigin.addYears(1));
+    }
+}
+
+void tst_bench::benchItemOccurrences()
+{
+    if (mRecurringItem.isEmpty()) {
+        QSKIP("No recurring event generated.");
+    }
+    QBENCHMARK {
+        mManager->itemOccurrences(mRecurringItem, mOrigin, mOrigin.addYears(1));
+    }
+}
+
+void tst_bench::benchFetchById()
+{
+    const QList<QOrganizerItemId> ids = mIds.mid(mIds.count() / 2, 200);
+    QBENCHMARK {
+        mManager->items(ids);
+    }
+}
+
+void tst_bench::benchCollections()
+{
+    QBENCHMARK {
+        mManager->collections();
+    }
+}
+
+QList<QOrganizerItem> tst_bench::newItems() const
+{
+    const int batch = qMax(1, parameter("BENCH_BATCH", 200));
+    QList<QOrganizerItem> items;
+    for (int i = 0; i < batch; i++) {
+        QOrganizerEvent event;
+        event.setDisplayLabel(QStringLiteral("Bulk event %1").arg(i));
+        event.setStartDateTime(mOrigin.addDays(i % 365).addSecs(9 * 3600));
+        event.setEndDateTime(event.startDateTime().addSecs(3600));
+        items << event;
+    }
+    return items;
+}
+
+void tst_bench::benchBulkSave()
+{
+    QList<QOrganizerItemId> saved;
+    QBENCHMARK {
+        QList<QOrganizerItem> items = newItems();
+        QVERIFY(mManager->saveItems(&items));
+        for (const QOrganizerItem &item : items) {
+            saved << item.id();
+        }
+    }
+    QVERIFY(mManager->removeItems(saved));
+}
+
+void tst_bench::benchBulkRemove()
+{
+    QList<QOrganizerItem> items = newItems();
+    QVERIFY(mManager->saveItems(&items));
+    QList<QOrganizerItemId> ids;
+    for (const QOrganizerItem &item : items) {
+        ids << item.id();
+    }
+    QBENCHMARK_ONCE {
+        QVERIFY(mManager->removeItems(ids));
+    }
+}
+
+QTEST_MAIN(tst_bench)
+#include "tst_bench.moc"
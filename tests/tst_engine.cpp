@@ -35,12 +35,17 @@
 #include <QString>
 #include <QSignalSpy>
 #include <QFileInfo>
+#include <QDir>
+#include <QBuffer>
+#include <QRegularExpression>
 
 #include <QOrganizerManager>
 #include <QOrganizerItemClassification>
+#include <QOrganizerItemDisplayLabel>
 #include <QOrganizerItemLocation>
 #include <QOrganizerItemPriority>
 #include <QOrganizerItemTimestamp>
+#include <QOrganizerItemExtendedDetail>
 #include <QOrganizerItemVersion>
 #include <QOrganizerItemAudibleReminder>
 #include <QOrganizerItemEmailReminder>
@@ -57,10 +62,18 @@
 #include <QOrganizerTodo>
 
 #include <QOrganizerItemCollectionFilter>
+#include <QOrganizerItemFetchRequest>
+#include <QOrganizerCollectionRemoveRequest>
+#include <QOrganizerItemDetailFieldFilter>
+#include <QOrganizerItemIntersectionFilter>
+#include <QOrganizerItemDetailRangeFilter>
 
 #include <extendedcalendar.h>
 #include <sqlitestorage.h>
 
+#include "mkcalplugin.h"
+#include "changejournal.h"
+
 using namespace QtOrganizer;
 
 class tst_engine: public QObject
@@ -91,6 +104,7 @@ private slots:
     void testItemAttendeeStatus();
     void testItemAttendeeRole_data();
     void testItemAttendeeRole();
+    void testItemResave();
 
     void testRecurringEventIO();
     void testExceptionIO();
@@ -98,6 +112,30 @@ private slots:
     void testSimpleTodoIO();
 
     void testSimpleRangeRead();
+    void testAttendeeFilter();
+    void testModifiedSince();
+    void testWriteBehind();
+    void testWriteBehindExternalChange();
+    void testWriteBehindMove();
+    void testDeferredPurge();
+    void testRemoveMatchingItems();
+    void testMoveItem();
+    void testMoveItems();
+    void testLargeSave();
+    void testCoalescedNotifications();
+    void testChangedDetails();
+    void testExternalItemChanges();
+    void testChangeLog();
+    void testSubscription();
+    void testCollectionStatistics();
+    void testCollectionRemovalProgress();
+    void testAsyncOpen();
+    void testAsyncOpenReady();
+    void testSharedWorker();
+    void testSharedWorkerSubscriptions();
+    void testImportItems();
+    void testMemoryReport();
+    void testMemoryReportLog();
 private:
     QOrganizerManager *mManager = nullptr;
 };
@@ -126,6 +164,21 @@ public:
     {
         return mCalendar->notebook(incidence);
     }
+    QList<QByteArray> notebookProperties(const QOrganizerCollectionId &collectionId)
+    {
+        mKCal::Notebook::Ptr nb = mStorage->notebook(QString::fromUtf8(collectionId.localId()));
+        QList<QByteArray> keys = nb ? nb->customPropertyKeys() : QList<QByteArray>();
+        keys.removeAll("secondaryColor");
+        keys.removeAll("image");
+        return keys;
+    }
+    int deletedCount(const QOrganizerCollectionId &collectionId)
+    {
+        KCalendarCore::Incidence::List deleted;
+        mStorage->deletedIncidences(&deleted, QDateTime(),
+                                    QString::fromUtf8(collectionId.localId()));
+        return deleted.count();
+    }
 
 signals:
     void dataChanged();
@@ -846,6 +899,81 @@ void tst_engine::testItemAttendeeRole()
     QCOMPARE(a.participationRole(), detail.participationRole());
 }
 
+void tst_engine::testItemResave()
+{
+    QOrganizerEvent item;
+    item.setDisplayLabel(QStringLiteral("Test saving unchanged items"));
+    item.setStartDateTime(QDateTime(QDate(2024, 10, 7),
+                                    QTime(10, 0), QTimeZone("Europe/Paris")));
+    item.setEndDateTime(item.startDateTime().addSecs(3600));
+    QOrganizerEventAttendee attendee;
+    attendee.setName(QStringLiteral("Alice"));
+    attendee.setEmailAddress(QStringLiteral("alice@example.org"));
+    item.saveDetail(&attendee);
+    QOrganizerItemVisualReminder reminder;
+    reminder.setSecondsBeforeStart(900);
+    reminder.setMessage(QStringLiteral("Test reminder"));
+    item.saveDetail(&reminder);
+    QOrganizerRecurrenceRule rule;
+    rule.setFrequency(QOrganizerRecurrenceRule::Weekly);
+    rule.setLimit(4);
+    item.setRecurrenceRule(rule);
+    QVERIFY(mManager->saveItem(&item));
+
+    QOrganizerItem read = mManager->item(item.id());
+    QVERIFY(!read.isEmpty());
+    DbObserver observer;
+    QSignalSpy dataChanged(&observer, &DbObserver::dataChanged);
+    QSignalSpy itemsChanged(mManager, &QOrganizerManager::itemsChanged);
+    QVERIFY(mManager->saveItem(&read));
+
+    // Saving an item as fetched writes nothing and notifies nothing,
+    // while a real change is seen by both.
+    QTest::qWait(200);
+    QCOMPARE(dataChanged.count(), 0);
+    QCOMPARE(itemsChanged.count(), 0);
+    QOrganizerItem modified = read;
+    modified.setDescription(QStringLiteral("Test resave description"));
+    QVERIFY(mManager->saveItem(&modified));
+    QTRY_COMPARE(dataChanged.count(), 1);
+    QTRY_COMPARE(itemsChanged.count(), 1);
+    QCOMPARE(itemsChanged.first().at(1).value<QList<QOrganizerItemDetail::DetailType>>(),
+             QList<QOrganizerItemDetail::DetailType>() << QOrganizerItemDetail::TypeDescription);
+
+    // Saving an item as fetched does not duplicate list details.
+    read = mManager->item(item.id());
+    QVERIFY(!read.isEmpty());
+    QCOMPARE(read.details(QOrganizerItemDetail::TypeEventAttendee).count(), 1);
+    QCOMPARE(read.details(QOrganizerItemDetail::TypeVisualReminder).count(), 1);
+    QCOMPARE(QOrganizerItemRecurrence(read.detail(QOrganizerItemDetail::TypeRecurrence)).recurrenceRules().count(), 1);
+
+    // Details outside of the mask are kept.
+    QOrganizerItem partial;
+    partial.setId(item.id());
+    partial.setType(QOrganizerItemType::TypeEvent);
+    partial.setCollectionId(read.collectionId());
+    partial.setDisplayLabel(QStringLiteral("Test updated label"));
+    QList<QOrganizerItem> items;
+    items << partial;
+    QVERIFY(mManager->saveItems(&items, QList<QOrganizerItemDetail::DetailType>() << QOrganizerItemDetail::TypeDisplayLabel));
+    read = mManager->item(item.id());
+    QVERIFY(!read.isEmpty());
+    QCOMPARE(read.displayLabel(), QStringLiteral("Test updated label"));
+    QCOMPARE(read.details(QOrganizerItemDetail::TypeEventAttendee).count(), 1);
+    QCOMPARE(read.details(QOrganizerItemDetail::TypeVisualReminder).count(), 1);
+
+    // Removed details are removed from the incidence.
+    QOrganizerItemDetail detail = read.detail(QOrganizerItemDetail::TypeEventAttendee);
+    QVERIFY(read.removeDetail(&detail));
+    QVERIFY(mManager->saveItem(&read));
+    read = mManager->item(item.id());
+    QVERIFY(!read.isEmpty());
+    QVERIFY(read.details(QOrganizerItemDetail::TypeEventAttendee).isEmpty());
+    QCOMPARE(read.details(QOrganizerItemDetail::TypeVisualReminder).count(), 1);
+
+    QVERIFY(mManager->removeItem(item.id()));
+}
+
 void tst_engine::testRecurringEventIO()
 {
     DbObserver observer;
@@ -1185,5 +1313,1159 @@ void tst_engine::testSimpleRangeRead()
     QCOMPARE(ids.takeFirst(), ex1.id());
 }
 
-#include "tst_engine.moc"
+void tst_engine::testAttendeeFilter()
+{
+    QOrganizerCollection collection;
+    collection.setMetaData(QOrganizerCollection::KeyName,
+                           QStringLiteral("Notebook for attendee tests"));
+    QVERIFY(mManager->saveCollection(&collection));
+    QCOMPARE(mManager->error(), QOrganizerManager::NoError);
+
+    QOrganizerEvent event1;
+    event1.setCollectionId(collection.id());
+    event1.setDisplayLabel(QStringLiteral("Meeting with Alice"));
+    event1.setStartDateTime(QDateTime(QDate(2024, 10, 7),
+                                      QTime(10, 0), QTimeZone("Europe/Paris")));
+    event1.setEndDateTime(event1.startDateTime().addSecs(3600));
+    QOrganizerEventAttendee alice;
+    alice.setName(QStringLiteral("Alice"));
+    alice.setEmailAddress(QStringLiteral("alice@example.org"));
+    event1.saveDetail(&alice);
+    QOrganizerEvent event2;
+    event2.setCollectionId(collection.id());
+    event2.setDisplayLabel(QStringLiteral("Meeting with Bob"));
+    event2.setStartDateTime(QDateTime(QDate(2024, 10, 8),
+                                      QTime(10, 0), QTimeZone("Europe/Paris")));
+    event2.setEndDateTime(event2.startDateTime().addSecs(3600));
+    QOrganizerEventAttendee bob;
+    bob.setName(QStringLiteral("Bob"));
+    bob.setEmailAddress(QStringLiteral("bob@example.org"));
+    event2.saveDetail(&bob);
+    QList<QOrganizerItem> items;
+    items << event1 << event2;
+    QVERIFY(mManager->saveItems(&items));
+    event1.setId(items.takeFirst().id());
+    event2.setId(items.takeFirst().id());
+
+    QOrganizerItemDetailFieldFilter attendee;
+    attendee.setDetail(QOrganizerItemDetail::TypeEventAttendee,
+                       QOrganizerEventAttendee::FieldEmailAddress);
+    attendee.setValue(QStringLiteral("Bob@example.org"));
+    QOrganizerItemCollectionFilter inCollection;
+    inCollection.setCollectionId(collection.id());
+    QOrganizerItemIntersectionFilter filter;
+    filter << attendee << inCollection;
+    const QDateTime start(QDate(2024, 10, 1), QTime(), QTimeZone("Europe/Paris"));
+    const QDateTime end(QDate(2024, 10, 31), QTime(), QTimeZone("Europe/Paris"));
+    items = mManager->items(start, end, filter);
+    QCOMPARE(mManager->error(), QOrganizerManager::NoError);
+    QCOMPARE(items.count(), 1);
+    QCOMPARE(items.first().id(), event2.id());
+
+    // The index follows updates of the attendee list.
+    event1.saveDetail(&bob);
+    QVERIFY(mManager->saveItem(&event1));
+    items = mManager->items(start, end, filter);
+    QCOMPARE(mManager->error(), QOrganizerManager::NoError);
+    QCOMPARE(items.count(), 2);
+
+    // And removals.
+    QVERIFY(mManager->removeItem(event2.id()));
+    items = mManager->items(start, end, filter);
+    QCOMPARE(mManager->error(), QOrganizerManager::NoError);
+    QCOMPARE(items.count(), 1);
+    QCOMPARE(items.first().id(), event1.id());
+
+    QVERIFY(mManager->removeCollection(collection.id()));
+}
+
+void tst_engine::testModifiedSince()
+{
+    QOrganizerCollection collection;
+    collection.setMetaData(QOrganizerCollection::KeyName,
+                           QStringLiteral("Notebook for delta tests"));
+    // Deleted incidences are kept until purged by the sync plugin.
+    collection.setExtendedMetaData(QStringLiteral("pluginName"),
+                                   QStringLiteral("test"));
+    QVERIFY(mManager->saveCollection(&collection));
+    QCOMPARE(mManager->error(), QOrganizerManager::NoError);
+
+    const QDateTime since = QDateTime::currentDateTimeUtc().addSecs(-1);
+
+    QOrganizerEvent event1;
+    event1.setCollectionId(collection.id());
+    event1.setDisplayLabel(QStringLiteral("Test event1"));
+    event1.setStartDateTime(QDateTime(QDate(2024, 10, 7),
+                                      QTime(10, 0), QTimeZone("Europe/Paris")));
+    event1.setEndDateTime(event1.startDateTime().addSecs(3600));
+    QOrganizerEvent event2;
+    event2.setCollectionId(collection.id());
+    event2.setDisplayLabel(QStringLiteral("Test event2"));
+    event2.setStartDateTime(QDateTime(QDate(2023, 3, 8),
+                                      QTime(10, 0), QTimeZone("Europe/Paris")));
+    event2.setEndDateTime(event2.startDateTime().addSecs(3600));
+    QList<QOrganizerItem> items;
+    items << event1 << event2;
+    QVERIFY(mManager->saveItems(&items));
+    event1.setId(items.takeFirst().id());
+    event2.setId(items.takeFirst().id());
+
+    QOrganizerItemDetailRangeFilter modified;
+    modified.setDetail(QOrganizerItemDetail::TypeTimestamp,
+                       QOrganizerItemTimestamp::FieldLastModified);
+    modified.setRange(since, QVariant());
+    QOrganizerItemCollectionFilter inCollection;
+    inCollection.setCollectionId(collection.id());
+    QOrganizerItemIntersectionFilter filter;
+    filter << modified << inCollection;
+
+    items = mManager->items(QDateTime(), QDateTime(), filter);
+    QCOMPARE(mManager->error(), QOrganizerManager::NoError);
+    QCOMPARE(items.count(), 2);
+
+    QVERIFY(mManager->removeItem(event1.id()));
+
+    items = mManager->items(QDateTime(), QDateTime(), filter);
+    QCOMPARE(mManager->error(), QOrganizerManager::NoError);
+    QCOMPARE(items.count(), 2);
+    for (const QOrganizerItem &item : items) {
+        const QOrganizerItemExtendedDetail detail(item.detail(QOrganizerItemDetail::TypeExtendedDetail));
+        if (item.id() == event1.id()) {
+            QCOMPARE(detail.name(), QStringLiteral("deleted"));
+            QVERIFY(detail.data().toDateTime().isValid());
+        } else {
+            QCOMPARE(item.id(), event2.id());
+            QVERIFY(detail.isEmpty());
+            QCOMPARE(item.displayLabel(), event2.displayLabel());
+        }
+    }
+
+    QVERIFY(mManager->removeCollection(collection.id()));
+}
+
+void tst_engine::testWriteBehind()
+{
+    QMap<QString, QString> parameters;
+    parameters.insert(QStringLiteral("databaseName"), QStringLiteral("db"));
+    parameters.insert(QStringLiteral("writeBehind"), QStringLiteral("true"));
+    // Never flushed during the test, only on destruction.
+    parameters.insert(QStringLiteral("flushInterval"), QStringLiteral("3600000"));
+    // Sessions without write-behind don't journal.
+    const QStringList journalFilter(QStringLiteral("db-writebehind-*"));
+    QVERIFY(QDir().entryList(journalFilter, QDir::Files).isEmpty());
+    QOrganizerManager *manager = new QOrganizerManager(QString::fromLatin1("mkcal"), parameters);
+    QCOMPARE(manager->error(), QOrganizerManager::NoError);
+
+    QOrganizerEvent event;
+    event.setDisplayLabel(QStringLiteral("Test write-behind event"));
+    event.setStartDateTime(QDateTime(QDate(2024, 10, 7),
+                                     QTime(10, 0), QTimeZone("Europe/Paris")));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    QVERIFY(manager->saveItem(&event));
+    QVERIFY(!event.id().isNull());
+
+    // Pending items are visible from their manager and journaled.
+    QCOMPARE(manager->item(event.id()).displayLabel(), event.displayLabel());
+    qint64 journaled = 0;
+    for (const QFileInfo &journal : QDir().entryInfoList(journalFilter, QDir::Files)) {
+        if (journal.suffix() != QStringLiteral("lock")) {
+            journaled += journal.size();
+        }
+    }
+    QVERIFY(journaled > 0);
+
+    // The session journal is removed once flushed.
+    delete manager;
+    QVERIFY(QDir().entryList(journalFilter, QDir::Files).isEmpty());
+
+    QOrganizerManager other(QString::fromLatin1("mkcal"),
+                            mManager->managerParameters());
+    QCOMPARE(other.error(), QOrganizerManager::NoError);
+    QCOMPARE(other.item(event.id()).displayLabel(), event.displayLabel());
+
+    QVERIFY(mManager->removeItem(event.id()));
+}
+
+void tst_engine::testWriteBehindExternalChange()
+{
+    QOrganizerEvent event;
+    event.setDisplayLabel(QStringLiteral("Test write-behind conflict"));
+    event.setStartDateTime(QDateTime(QDate(2024, 10, 8),
+                                     QTime(10, 0), QTimeZone("Europe/Paris")));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    QVERIFY(mManager->saveItem(&event));
+
+    QMap<QString, QString> parameters;
+    parameters.insert(QStringLiteral("databaseName"), QStringLiteral("db"));
+    parameters.insert(QStringLiteral("writeBehind"), QStringLiteral("true"));
+    parameters.insert(QStringLiteral("flushInterval"), QStringLiteral("3600000"));
+    QOrganizerManager *manager = new QOrganizerManager(QString::fromLatin1("mkcal"), parameters);
+    QCOMPARE(manager->error(), QOrganizerManager::NoError);
+    QOrganizerItem local = manager->item(event.id());
+    QVERIFY(!local.isEmpty());
+    local.setDisplayLabel(QStringLiteral("Test write-behind conflict, local"));
+    QVERIFY(manager->saveItem(&local));
+
+    QSignalSpy dataChanged(manager, &QOrganizerManager::dataChanged);
+    QSignalSpy itemsChanged(manager, &QOrganizerManager::itemsChanged);
+    mKCal::ExtendedCalendar::Ptr cal(new mKCal::ExtendedCalendar(QTimeZone()));
+    mKCal::SqliteStorage storage(cal, QStringLiteral("db"));
+    QVERIFY(storage.open());
+    QVERIFY(storage.load(QString::fromUtf8(event.id().localId())));
+    KCalendarCore::Incidence::Ptr incidence = cal->incidence(QString::fromUtf8(event.id().localId()));
+    QVERIFY(incidence);
+    incidence->setSummary(QStringLiteral("Test write-behind conflict, external"));
+    QVERIFY(storage.save());
+
+    // The pending local change is kept in memory and
+    // then written over the external one.
+    QTRY_VERIFY(dataChanged.count() > 0);
+    QVERIFY(itemsChanged.isEmpty());
+    QCOMPARE(manager->item(event.id()).displayLabel(), local.displayLabel());
+    delete manager;
+    mKCal::ExtendedCalendar::Ptr saved(new mKCal::ExtendedCalendar(QTimeZone()));
+    mKCal::SqliteStorage savedStorage(saved, QStringLiteral("db"));
+    QVERIFY(savedStorage.open());
+    QVERIFY(savedStorage.load(QString::fromUtf8(event.id().localId())));
+    incidence = saved->incidence(QString::fromUtf8(event.id().localId()));
+    QVERIFY(incidence);
+    QCOMPARE(incidence->summary(), local.displayLabel());
+
+    QVERIFY(mManager->removeItem(event.id()));
+}
+
+void tst_engine::testWriteBehindMove()
+{
+    QOrganizerCollection source;
+    source.setMetaData(QOrganizerCollection::KeyName,
+                       QStringLiteral("Test write-behind move source"));
+    QVERIFY(mManager->saveCollection(&source));
+    QOrganizerCollection target;
+    target.setMetaData(QOrganizerCollection::KeyName,
+                       QStringLiteral("Test write-behind move target"));
+    QVERIFY(mManager->saveCollection(&target));
+
+    QOrganizerEvent parent;
+    parent.setCollectionId(source.id());
+    parent.setDisplayLabel(QStringLiteral("Test write-behind moved series"));
+    parent.setStartDateTime(QDateTime(QDate(2024, 10, 14),
+                                      QTime(10, 0), QTimeZone("Europe/Paris")));
+    parent.setEndDateTime(parent.startDateTime().addSecs(3600));
+    QOrganizerRecurrenceRule rule;
+    rule.setFrequency(QOrganizerRecurrenceRule::Daily);
+    rule.setLimit(5);
+    parent.setRecurrenceRule(rule);
+    QVERIFY(mManager->saveItem(&parent));
+    QOrganizerEventOccurrence exception;
+    exception.setCollectionId(source.id());
+    exception.setParentId(parent.id());
+    exception.setOriginalDate(QDate(2024, 10, 15));
+    exception.setDisplayLabel(QStringLiteral("Test write-behind moved exception"));
+    exception.setStartDateTime(QDateTime(QDate(2024, 10, 15),
+                                         QTime(11, 0), QTimeZone("Europe/Paris")));
+    exception.setEndDateTime(exception.startDateTime().addSecs(3600));
+    QVERIFY(mManager->saveItem(&exception));
+
+    // Keep the journal of the session as it was before its flush.
+    const QStringList journalFilter(QStringLiteral("db-writebehind-*"));
+    QByteArray journaled;
+    {
+        mKCalOptions options;
+        options.writeBehind = true;
+        options.flushInterval = 3600000;
+        mKCalEngine engine(QTimeZone(), QStringLiteral("db"), options);
+        QOrganizerManager::Error error = QOrganizerManager::NoError;
+        QMap<int, QOrganizerManager::Error> errors;
+        QList<QOrganizerItem> items
+            = engine.items(QList<QOrganizerItemId>() << parent.id(),
+                           QOrganizerItemFetchHint(), &errors, &error);
+        QCOMPARE(items.count(), 1);
+        items.first().setCollectionId(target.id());
+        QVERIFY(engine.saveItems(&items, QList<QOrganizerItemDetail::DetailType>(),
+                                 &errors, &error));
+        for (const QFileInfo &info : QDir().entryInfoList(journalFilter, QDir::Files)) {
+            if (info.suffix() != QStringLiteral("lock")) {
+                QFile file(info.filePath());
+                QVERIFY(file.open(QIODevice::ReadOnly));
+                journaled += file.readAll();
+            }
+        }
+    }
+
+    // The whole series is journaled with its new collection.
+    QFile crashed(QStringLiteral("db-writebehind-crashed"));
+    QVERIFY(crashed.open(QIODevice::WriteOnly));
+    QCOMPARE(crashed.write(journaled), qint64(journaled.size()));
+    crashed.close();
+    QSet<QString> instances;
+    {
+        ChangeJournal journal(crashed.fileName());
+        for (const ChangeJournal::Entry &entry : journal.entries()) {
+            if (entry.notebookUid.toUtf8() == target.id().localId()) {
+                instances.insert(entry.incidence->instanceIdentifier());
+            }
+        }
+    }
+    QVERIFY(instances.contains(QString::fromUtf8(parent.id().localId())));
+    QVERIFY(instances.contains(QString::fromUtf8(exception.id().localId())));
+
+    // As if the session had crashed before its flush.
+    QTRY_COMPARE(mManager->item(parent.id()).collectionId(), target.id());
+    QOrganizerItem moved = mManager->item(parent.id());
+    moved.setCollectionId(source.id());
+    QVERIFY(mManager->saveItem(&moved));
+
+    {
+        mKCalEngine engine(QTimeZone(), QStringLiteral("db"));
+        QVERIFY(engine.isOpened());
+    }
+    QVERIFY(!crashed.exists());
+    mKCal::ExtendedCalendar::Ptr saved(new mKCal::ExtendedCalendar(QTimeZone()));
+    mKCal::SqliteStorage storage(saved, QStringLiteral("db"));
+    QVERIFY(storage.open());
+    QVERIFY(storage.load(QString::fromUtf8(parent.id().localId())));
+    KCalendarCore::Incidence::Ptr incidence = saved->instance(QString::fromUtf8(parent.id().localId()));
+    QVERIFY(incidence);
+    QCOMPARE(saved->notebook(incidence).toUtf8(), target.id().localId());
+    incidence = saved->instance(QString::fromUtf8(exception.id().localId()));
+    QVERIFY(incidence);
+    QCOMPARE(saved->notebook(incidence).toUtf8(), target.id().localId());
+
+    QVERIFY(mManager->removeCollection(source.id()));
+    QVERIFY(mManager->removeCollection(target.id()));
+}
+
+void tst_engine::testDeferredPurge()
+{
+    DbObserver observer;
+
+    QOrganizerEvent event;
+    event.setDisplayLabel(QStringLiteral("Test purged event"));
+    event.setStartDateTime(QDateTime(QDate(2024, 10, 7),
+                                     QTime(10, 0), QTimeZone("Europe/Paris")));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    QVERIFY(mManager->saveItem(&event));
+    QVERIFY(mManager->removeItem(event.id()));
+
+    // Deletions of local notebooks are purged later, in batches.
+    QVERIFY(observer.deletedCount(event.collectionId()) > 0);
+    QTRY_COMPARE(observer.deletedCount(event.collectionId()), 0);
+}
+
+void tst_engine::testRemoveMatchingItems()
+{
+    QOrganizerCollection local;
+    local.setMetaData(QOrganizerCollection::KeyName,
+                      QStringLiteral("Test local removal"));
+    QVERIFY(mManager->saveCollection(&local));
+    // Notebooks of a sync plugin keep their deletions.
+    mKCal::ExtendedCalendar::Ptr cal(new mKCal::ExtendedCalendar(QTimeZone()));
+    mKCal::SqliteStorage storage(cal, QStringLiteral("db"));
+    QVERIFY(storage.open());
+    mKCal::Notebook::Ptr notebook(new mKCal::Notebook(QStringLiteral("Test synced removal"),
+                                                      QString()));
+    notebook->setPluginName(QStringLiteral("tst_engine"));
+    QVERIFY(storage.addNotebook(notebook));
+
+    mKCalEngine engine(QTimeZone(), QStringLiteral("db"));
+    QVERIFY(engine.isOpened());
+    const QOrganizerCollectionId synced(engine.managerUri(), notebook->uid().toUtf8());
+    QList<QOrganizerItem> items;
+    for (const QOrganizerCollectionId &collectionId : {local.id(), synced}) {
+        QOrganizerEvent event;
+        event.setCollectionId(collectionId);
+        event.setDisplayLabel(QStringLiteral("Test removed event"));
+        event.setStartDateTime(QDateTime(QDate(2024, 12, 2), QTime(10, 0), Qt::UTC));
+        event.setEndDateTime(event.startDateTime().addSecs(3600));
+        items << event;
+        // Outside of the range.
+        event.setStartDateTime(QDateTime(QDate(2024, 12, 20), QTime(10, 0), Qt::UTC));
+        event.setEndDateTime(event.startDateTime().addSecs(3600));
+        items << event;
+        // Not matching the filter.
+        event.setDisplayLabel(QStringLiteral("Test kept event"));
+        event.setStartDateTime(QDateTime(QDate(2024, 12, 2), QTime(12, 0), Qt::UTC));
+        event.setEndDateTime(event.startDateTime().addSecs(3600));
+        items << event;
+    }
+    QMap<int, QOrganizerManager::Error> errors;
+    QOrganizerManager::Error error = QOrganizerManager::NoError;
+    QVERIFY(engine.saveItems(&items, QList<QOrganizerItemDetail::DetailType>(),
+                             &errors, &error));
+
+    QOrganizerItemDetailFieldFilter label;
+    label.setDetail(QOrganizerItemDetail::TypeDisplayLabel,
+                    QOrganizerItemDisplayLabel::FieldLabel);
+    label.setValue(QStringLiteral("Test removed"));
+    label.setMatchFlags(QOrganizerItemFilter::MatchStartsWith);
+    const QDateTime start(QDate(2024, 12, 1), QTime(0, 0), Qt::UTC);
+    const QDateTime end(QDate(2024, 12, 10), QTime(0, 0), Qt::UTC);
+    DbObserver observer;
+    for (const QOrganizerCollectionId &collectionId : {local.id(), synced}) {
+        QOrganizerItemCollectionFilter inCollection;
+        inCollection.setCollectionId(collectionId);
+        QOrganizerItemIntersectionFilter filter;
+        filter << label << inCollection;
+        QCOMPARE(engine.removeMatchingItems(filter, start, end, &error), 1);
+        QCOMPARE(error, QOrganizerManager::NoError);
+
+        const QList<QOrganizerItem> remaining
+            = engine.items(inCollection, start, end.addMonths(1), -1,
+                           QList<QOrganizerItemSortOrder>(),
+                           QOrganizerItemFetchHint(), &error);
+        QCOMPARE(remaining.count(), 2);
+        for (const QOrganizerItem &item : remaining) {
+            QVERIFY(item.id() != items.at(collectionId == synced ? 3 : 0).id());
+        }
+    }
+    // Purged from the local notebook, marked deleted in the synced one.
+    QCOMPARE(observer.deletedCount(local.id()), 0);
+    QCOMPARE(observer.deletedCount(synced), 1);
+
+    QVERIFY(mManager->removeCollection(local.id()));
+    QVERIFY(storage.deleteNotebook(notebook));
+}
+
+void tst_engine::testMoveItem()
+{
+    QOrganizerCollection collection;
+    collection.setMetaData(QOrganizerCollection::KeyName,
+                           QStringLiteral("Notebook for move tests"));
+    QVERIFY(mManager->saveCollection(&collection));
+
+    QOrganizerEvent event;
+    event.setDisplayLabel(QStringLiteral("Test moved event"));
+    event.setStartDateTime(QDateTime(QDate(2024, 10, 7),
+                                     QTime(10, 0), QTimeZone("Europe/Paris")));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    QVERIFY(mManager->saveItem(&event));
+    QCOMPARE(event.collectionId(), mManager->defaultCollectionId());
+    const QOrganizerItemId id = event.id();
+
+    DbObserver observer;
+    QSignalSpy dataChanged(&observer, &DbObserver::dataChanged);
+    QSignalSpy itemsChanged(mManager, &QOrganizerManager::itemsChanged);
+    QSignalSpy itemsAdded(mManager, &QOrganizerManager::itemsAdded);
+    event.setCollectionId(collection.id());
+    QVERIFY(mManager->saveItem(&event));
+    QCOMPARE(event.id(), id);
+
+    // The incidence keeps its uid, no delete and add cycle.
+    QTRY_COMPARE(dataChanged.count(), 1);
+    QCOMPARE(itemsChanged.count(), 1);
+    QCOMPARE(itemsAdded.count(), 0);
+    QCOMPARE(mManager->item(id).collectionId(), collection.id());
+    KCalendarCore::Incidence::Ptr incidence = observer.incidence(id);
+    QVERIFY(incidence);
+    QCOMPARE(observer.notebookUid(incidence), QString::fromUtf8(collection.id().localId()));
+
+    QVERIFY(mManager->removeCollection(collection.id()));
+}
+
+void tst_engine::testMoveItems()
+{
+    QOrganizerCollection source;
+    source.setMetaData(QOrganizerCollection::KeyName,
+                       QStringLiteral("Test bulk move source"));
+    QVERIFY(mManager->saveCollection(&source));
+    QOrganizerCollection target;
+    target.setMetaData(QOrganizerCollection::KeyName,
+                       QStringLiteral("Test bulk move target"));
+    QVERIFY(mManager->saveCollection(&target));
+
+    QList<QOrganizerItem> items;
+    for (int i = 0; i < 3; i++) {
+        QOrganizerEvent event;
+        event.setCollectionId(source.id());
+        event.setDisplayLabel(QStringLiteral("Test bulk moved event %1").arg(i));
+        event.setStartDateTime(QDateTime(QDate(2024, 12, 9 + i),
+                                         QTime(10, 0), QTimeZone("Europe/Paris")));
+        event.setEndDateTime(event.startDateTime().addSecs(3600));
+        items << event;
+    }
+    QVERIFY(mManager->saveItems(&items));
+    QList<QOrganizerItemId> ids;
+    for (const QOrganizerItem &item : items) {
+        ids << item.id();
+    }
+
+    mKCal::ExtendedCalendar::Ptr cal(new mKCal::ExtendedCalendar(QTimeZone()));
+    mKCal::SqliteStorage storage(cal, QStringLiteral("db"));
+    QVERIFY(storage.open());
+    mKCal::Notebook::Ptr notebook(new mKCal::Notebook(QStringLiteral("Test read-only source"),
+                                                      QString()));
+    QVERIFY(storage.addNotebook(notebook));
+    KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+    event->setSummary(QStringLiteral("Test read-only event"));
+    event->setDtStart(QDateTime(QDate(2024, 12, 9), QTime(10, 0), Qt::UTC));
+    event->setDtEnd(event->dtStart().addSecs(3600));
+    QVERIFY(cal->addEvent(event, notebook->uid()));
+    QVERIFY(storage.save());
+    notebook->setIsReadOnly(true);
+    QVERIFY(storage.updateNotebook(notebook));
+
+    mKCalEngine engine(QTimeZone(), QStringLiteral("db"));
+    QVERIFY(engine.isOpened());
+    DbObserver observer;
+    QSignalSpy dataChanged(&observer, &DbObserver::dataChanged);
+    // Unknown items are skipped.
+    QOrganizerManager::Error error = QOrganizerManager::NoError;
+    QCOMPARE(engine.moveItems(ids + (QList<QOrganizerItemId>() << QOrganizerItemId(engine.managerUri(), "unknown")),
+                              target.id(), &error), 3);
+    QCOMPARE(error, QOrganizerManager::NoError);
+    QTRY_VERIFY(dataChanged.count() > 0);
+    for (const QOrganizerItemId &id : ids) {
+        KCalendarCore::Incidence::Ptr incidence = observer.incidence(id);
+        QVERIFY(incidence);
+        QCOMPARE(observer.notebookUid(incidence), QString::fromUtf8(target.id().localId()));
+    }
+
+    // Items of a read-only notebook stay where they are.
+    const QOrganizerItemId id(engine.managerUri(), event->instanceIdentifier().toUtf8());
+    QCOMPARE(engine.moveItems(QList<QOrganizerItemId>() << id, target.id(), &error), 0);
+    QCOMPARE(error, QOrganizerManager::NoError);
+    QMap<int, QOrganizerManager::Error> errors;
+    const QList<QOrganizerItem> unmoved
+        = engine.items(QList<QOrganizerItemId>() << id, QOrganizerItemFetchHint(),
+                       &errors, &error);
+    QCOMPARE(unmoved.count(), 1);
+    QCOMPARE(unmoved.first().collectionId().localId(), notebook->uid().toUtf8());
+
+    QVERIFY(storage.deleteNotebook(notebook));
+    QVERIFY(mManager->removeCollection(source.id()));
+    QVERIFY(mManager->removeCollection(target.id()));
+}
+
+void tst_engine::testLargeSave()
+{
+    QOrganizerCollection collection;
+    collection.setMetaData(QOrganizerCollection::KeyName,
+                           QStringLiteral("Notebook for large saves"));
+    QVERIFY(mManager->saveCollection(&collection));
+
+    // Enough items to be converted in parallel.
+    QList<QOrganizerItem> items;
+    for (int i = 0; i < 200; i++) {
+        QOrganizerEvent event;
+        event.setCollectionId(collection.id());
+        event.setDisplayLabel(QStringLiteral("Test event %1").arg(i));
+        event.setStartDateTime(QDateTime(QDate(2024, 10, 1).addDays(i % 30),
+                                         QTime(10, 0), QTimeZone("Europe/Paris")));
+        event.setEndDateTime(event.startDateTime().addSecs(3600));
+        items << event;
+    }
+    QVERIFY(mManager->saveItems(&items));
+    QSet<QOrganizerItemId> ids;
+    for (const QOrganizerItem &item : items) {
+        QVERIFY(!item.id().isNull());
+        ids.insert(item.id());
+    }
+    QCOMPARE(ids.count(), items.count());
+
+    QOrganizerItemCollectionFilter filter;
+    filter.setCollectionId(collection.id());
+    const QList<QOrganizerItem> read
+        = mManager->items(QDateTime(QDate(2024, 10, 1), QTime(), QTimeZone("Europe/Paris")),
+                          QDateTime(QDate(2024, 11, 1), QTime(), QTimeZone("Europe/Paris")),
+                          filter);
+    QCOMPARE(read.count(), items.count());
+    for (const QOrganizerItem &item : read) {
+        QVERIFY(ids.contains(item.id()));
+    }
+
+    QVERIFY(mManager->removeCollection(collection.id()));
+}
+
+void tst_engine::testCoalescedNotifications()
+{
+    QMap<QString, QString> parameters;
+    parameters.insert(QStringLiteral("databaseName"), QStringLiteral("db"));
+    parameters.insert(QStringLiteral("notificationWindow"), QStringLiteral("500"));
+    QOrganizerManager manager(QString::fromLatin1("mkcal"), parameters);
+    QCOMPARE(manager.error(), QOrganizerManager::NoError);
+
+    QSignalSpy added(&manager, &QOrganizerManager::itemsAdded);
+    QSignalSpy changed(&manager, &QOrganizerManager::itemsChanged);
+    QSignalSpy removed(&manager, &QOrganizerManager::itemsRemoved);
+
+    QOrganizerEvent event1;
+    event1.setDisplayLabel(QStringLiteral("Test coalesced event1"));
+    event1.setStartDateTime(QDateTime(QDate(2024, 10, 7),
+                                      QTime(10, 0), QTimeZone("Europe/Paris")));
+    event1.setEndDateTime(event1.startDateTime().addSecs(3600));
+    QOrganizerEvent event2 = event1;
+    event2.setDisplayLabel(QStringLiteral("Test coalesced event2"));
+    QVERIFY(manager.saveItem(&event1));
+    QVERIFY(manager.saveItem(&event2));
+    event1.setDisplayLabel(QStringLiteral("Test coalesced event1, modified"));
+    QVERIFY(manager.saveItem(&event1));
+    QVERIFY(manager.removeItem(event2.id()));
+
+    // Added then modified is one addition, added then removed is nothing.
+    QTRY_COMPARE(added.count(), 1);
+    QCOMPARE(added.first().first().value<QList<QOrganizerItemId>>(),
+             QList<QOrganizerItemId>() << event1.id());
+    QCOMPARE(changed.count(), 0);
+    QCOMPARE(removed.count(), 0);
+
+    QVERIFY(manager.removeItem(event1.id()));
+    QTRY_COMPARE(removed.count(), 1);
+}
+
+void tst_engine::testChangedDetails()
+{
+    QOrganizerEvent event;
+    event.setDisplayLabel(QStringLiteral("Test changed details"));
+    event.setStartDateTime(QDateTime(QDate(2024, 10, 7),
+                                     QTime(10, 0), QTimeZone("Europe/Paris")));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    QVERIFY(mManager->saveItem(&event));
+
+    QSignalSpy changed(mManager, &QOrganizerManager::itemsChanged);
+    event.setDisplayLabel(QStringLiteral("Test changed details, modified"));
+    QVERIFY(mManager->saveItem(&event));
+    QTRY_COMPARE(changed.count(), 1);
+    QCOMPARE(changed.first().at(0).value<QList<QOrganizerItemId>>(),
+             QList<QOrganizerItemId>() << event.id());
+    QCOMPARE(changed.first().at(1).value<QList<QOrganizerItemDetail::DetailType>>(),
+             QList<QOrganizerItemDetail::DetailType>() << QOrganizerItemDetail::TypeDisplayLabel);
+
+    QVERIFY(mManager->removeItem(event.id()));
+}
+
+void tst_engine::testExternalItemChanges()
+{
+    mKCal::ExtendedCalendar::Ptr cal(new mKCal::ExtendedCalendar(QTimeZone()));
+    mKCal::SqliteStorage storage(cal, QStringLiteral("db"));
+    storage.open();
+
+    QSignalSpy added(mManager, &QOrganizerManager::itemsAdded);
+    QSignalSpy changed(mManager, &QOrganizerManager::itemsChanged);
+    QSignalSpy removed(mManager, &QOrganizerManager::itemsRemoved);
+    QSignalSpy dataChanged(mManager, &QOrganizerManager::dataChanged);
+
+    KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+    event->setSummary(QStringLiteral("Test external event"));
+    event->setDtStart(QDateTime(QDate(2024, 10, 8), QTime(10, 0), Qt::UTC));
+    event->setDtEnd(event->dtStart().addSecs(3600));
+    QVERIFY(cal->addEvent(event, QString::fromUtf8(mManager->defaultCollectionId().localId())));
+    QVERIFY(storage.save());
+    const QOrganizerItemId id(mManager->managerUri(), event->instanceIdentifier().toUtf8());
+    QTRY_COMPARE(added.count(), 1);
+    QCOMPARE(added.takeFirst().first().value<QList<QOrganizerItemId>>(),
+             QList<QOrganizerItemId>() << id);
+    QCOMPARE(mManager->item(id).displayLabel(), event->summary());
+
+    event->setSummary(QStringLiteral("Test external event, modified"));
+    QVERIFY(storage.save());
+    QTRY_COMPARE(changed.count(), 1);
+    QCOMPARE(changed.takeFirst().first().value<QList<QOrganizerItemId>>(),
+             QList<QOrganizerItemId>() << id);
+    QCOMPARE(mManager->item(id).displayLabel(), event->summary());
+
+    QVERIFY(cal->deleteIncidence(event));
+    QVERIFY(storage.save());
+    QTRY_COMPARE(removed.count(), 1);
+    QCOMPARE(removed.takeFirst().first().value<QList<QOrganizerItemId>>(),
+             QList<QOrganizerItemId>() << id);
+    QVERIFY(mManager->item(id).id().isNull());
+    QVERIFY(added.isEmpty());
+    QVERIFY(dataChanged.isEmpty());
+}
+
+static bool isLogged(const ChangeLog::Feed &feed, const QOrganizerItemId &id,
+                     ChangeLog::Operation operation)
+{
+    for (const ChangeLog::Change &change : feed.changes) {
+        if (change.uid.toUtf8() == id.localId() && change.operation == operation) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void tst_engine::testChangeLog()
+{
+    mKCalEngine engine(QTimeZone(), QStringLiteral("db"));
+    QVERIFY(engine.isOpened());
+    QOrganizerManager::Error error = QOrganizerManager::NoError;
+    const qint64 start = engine.changesSince(0, &error).lastSequence;
+    QCOMPARE(error, QOrganizerManager::NoError);
+
+    QOrganizerEvent event;
+    event.setDisplayLabel(QStringLiteral("Test logged event"));
+    event.setStartDateTime(QDateTime(QDate(2024, 12, 16),
+                                     QTime(10, 0), QTimeZone("Europe/Paris")));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    QVERIFY(mManager->saveItem(&event));
+    ChangeLog::Feed feed = engine.changesSince(start, &error);
+    QVERIFY(feed.complete);
+    QVERIFY(isLogged(feed, event.id(), ChangeLog::ItemAdded));
+    QVERIFY(feed.lastSequence > start);
+
+    // Writes done without this plugin are logged when found.
+    mKCal::ExtendedCalendar::Ptr cal(new mKCal::ExtendedCalendar(QTimeZone()));
+    mKCal::SqliteStorage storage(cal, QStringLiteral("db"));
+    QVERIFY(storage.open());
+    QVERIFY(storage.load(QString::fromUtf8(event.id().localId())));
+    KCalendarCore::Incidence::Ptr incidence = cal->incidence(QString::fromUtf8(event.id().localId()));
+    QVERIFY(incidence);
+    incidence->setSummary(QStringLiteral("Test logged event, modified externally"));
+    QVERIFY(storage.save());
+    QTRY_VERIFY(isLogged(engine.changesSince(feed.lastSequence, &error),
+                         event.id(), ChangeLog::ItemModified));
+    QVERIFY(engine.changesSince(feed.lastSequence, &error).complete);
+
+    QVERIFY(mManager->removeItem(event.id()));
+    QVERIFY(isLogged(engine.changesSince(feed.lastSequence, &error),
+                     event.id(), ChangeLog::ItemRemoved));
+}
+
+void tst_engine::testSubscription()
+{
+    QOrganizerCollection collection;
+    collection.setMetaData(QOrganizerCollection::KeyName,
+                           QStringLiteral("Test subscription"));
+    QVERIFY(mManager->saveCollection(&collection));
+
+    mKCalEngine engine(QTimeZone(), QStringLiteral("db"));
+    QVERIFY(engine.isOpened());
+    QOrganizerManager::Error error = QOrganizerManager::NoError;
+    const QDateTime start(QDate(2024, 12, 23), QTime(0, 0), Qt::UTC);
+    const QDateTime end(QDate(2024, 12, 30), QTime(0, 0), Qt::UTC);
+    const int subscription
+        = engine.subscribe(QList<QOrganizerCollectionId>() << collection.id(),
+                           start, end, QList<QOrganizerItemType::ItemType>(), &error);
+    QCOMPARE(error, QOrganizerManager::NoError);
+    QVERIFY(subscription > 0);
+
+    QSignalSpy added(&engine, &QOrganizerManagerEngine::itemsAdded);
+    QList<QOrganizerItem> items;
+    QOrganizerEvent event;
+    event.setCollectionId(collection.id());
+    event.setDisplayLabel(QStringLiteral("Test subscribed event"));
+    event.setStartDateTime(start.addDays(1));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    items << event;
+    // Out of the window.
+    event.setStartDateTime(end.addDays(1));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    items << event;
+    // In another collection.
+    event.setCollectionId(engine.defaultCollectionId());
+    event.setStartDateTime(start.addDays(1));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    items << event;
+    QMap<int, QOrganizerManager::Error> errors;
+    QVERIFY(engine.saveItems(&items, QList<QOrganizerItemDetail::DetailType>(),
+                             &errors, &error));
+    QTRY_COMPARE(added.count(), 1);
+    QCOMPARE(added.first().first().value<QList<QOrganizerItemId>>(),
+             QList<QOrganizerItemId>() << items.first().id());
+
+    // Without subscription, all changes are notified again.
+    engine.unsubscribe(subscription);
+    added.clear();
+    QList<QOrganizerItemId> ids;
+    for (const QOrganizerItem &item : items) {
+        ids << item.id();
+    }
+    QSignalSpy removed(&engine, &QOrganizerManagerEngine::itemsRemoved);
+    QVERIFY(engine.removeItems(ids, &errors, &error));
+    QTRY_COMPARE(removed.count(), 1);
+    QCOMPARE(removed.first().first().value<QList<QOrganizerItemId>>().count(), 3);
+
+    QVERIFY(mManager->removeCollection(collection.id()));
+}
+
+void tst_engine::testCollectionStatistics()
+{
+    QOrganizerCollection collection;
+    collection.setMetaData(QOrganizerCollection::KeyName,
+                           QStringLiteral("Test statistics"));
+    QVERIFY(mManager->saveCollection(&collection));
+    collection = mManager->collection(collection.id());
+    QCOMPARE(collection.extendedMetaData(QStringLiteral("itemCount")), QVariant(0));
+    QCOMPARE(collection.extendedMetaData(QStringLiteral("pendingChanges")), QVariant(0));
+
+    // Statistics are not stored with the notebook.
+    QVERIFY(mManager->saveCollection(&collection));
+    DbObserver observer;
+    QVERIFY(observer.notebookProperties(collection.id()).isEmpty());
+
+    QOrganizerEvent event;
+    event.setCollectionId(collection.id());
+    event.setDisplayLabel(QStringLiteral("Test statistics event"));
+    event.setStartDateTime(QDateTime(QDate(2024, 10, 9),
+                                     QTime(10, 0), QTimeZone("Europe/Paris")));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    QVERIFY(mManager->saveItem(&event));
+    QTRY_COMPARE(mManager->collection(collection.id()).extendedMetaData(QStringLiteral("itemCount")),
+                 QVariant(1));
+    collection = mManager->collection(collection.id());
+    QCOMPARE(collection.extendedMetaData(QStringLiteral("earliestDate")).toDateTime(),
+             event.startDateTime());
+    QCOMPARE(collection.extendedMetaData(QStringLiteral("latestDate")).toDateTime(),
+             event.endDateTime());
+
+    QVERIFY(mManager->removeItem(event.id()));
+    QTRY_COMPARE(mManager->collection(collection.id()).extendedMetaData(QStringLiteral("itemCount")),
+                 QVariant(0));
+
+    QVERIFY(mManager->removeCollection(collection.id()));
+}
+
+void tst_engine::testCollectionRemovalProgress()
+{
+    mKCalOptions options;
+    options.writeBehind = true;
+    options.flushInterval = 3600000;
+    mKCalEngine engine(QTimeZone(), QStringLiteral("db"), options);
+    QVERIFY(engine.isOpened());
+
+    QOrganizerCollection collection;
+    collection.setMetaData(QOrganizerCollection::KeyName,
+                           QStringLiteral("Test removal progress"));
+    QOrganizerManager::Error error = QOrganizerManager::NoError;
+    QVERIFY(engine.saveCollection(&collection, &error));
+    // More than one removal chunk.
+    QList<QOrganizerItem> items;
+    for (int i = 0; i < 1500; i++) {
+        QOrganizerEvent event;
+        event.setCollectionId(collection.id());
+        event.setDisplayLabel(QStringLiteral("Test removed event %1").arg(i));
+        event.setStartDateTime(QDateTime(QDate(2025, 1, 1).addDays(i % 30),
+                                         QTime(10, 0), Qt::UTC));
+        event.setEndDateTime(event.startDateTime().addSecs(3600));
+        items << event;
+    }
+    // Not flushed yet when the removal starts.
+    QOrganizerEvent other;
+    other.setDisplayLabel(QStringLiteral("Test event kept on removal"));
+    other.setStartDateTime(QDateTime(QDate(2025, 1, 2), QTime(10, 0), Qt::UTC));
+    other.setEndDateTime(other.startDateTime().addSecs(3600));
+    items << other;
+    QMap<int, QOrganizerManager::Error> errors;
+    QVERIFY(engine.saveItems(&items, QList<QOrganizerItemDetail::DetailType>(),
+                             &errors, &error));
+
+    QSignalSpy added(&engine, &QOrganizerManagerEngine::itemsAdded);
+    QSignalSpy removed(&engine, &QOrganizerManagerEngine::itemsRemoved);
+    QSignalSpy collectionsRemoved(&engine, &QOrganizerManagerEngine::collectionsRemoved);
+    QSignalSpy progress(&engine, &mKCalEngine::collectionRemovalProgress);
+    int progressWhenFinished = -1;
+    QOrganizerCollectionRemoveRequest request;
+    request.setCollectionId(collection.id());
+    connect(&request, &QOrganizerAbstractRequest::stateChanged,
+            &engine, [&] (QOrganizerAbstractRequest::State state) {
+                         if (state == QOrganizerAbstractRequest::FinishedState) {
+                             progressWhenFinished = progress.count();
+                         }
+                     });
+    QVERIFY(engine.startRequest(&request));
+    QTRY_VERIFY(request.isFinished());
+    QCOMPARE(request.error(), QOrganizerManager::NoError);
+
+    // The progress is received while the removal runs.
+    QTRY_COMPARE(progressWhenFinished, 2);
+    QCOMPARE(progress.at(0).at(1).toInt(), 1000);
+    QCOMPARE(progress.at(1).at(1).toInt(), 1500);
+    QCOMPARE(progress.at(1).at(2).toInt(), 1500);
+    // Pending changes were saved and notified on their own.
+    QTRY_VERIFY(!added.isEmpty());
+    QVERIFY(added.first().first().value<QList<QOrganizerItemId>>().contains(items.last().id()));
+    QCOMPARE(collectionsRemoved.count(), 1);
+    QVERIFY(removed.isEmpty());
+
+    QVERIFY(engine.removeItems(QList<QOrganizerItemId>() << items.last().id(),
+                               &errors, &error));
+}
+
+void tst_engine::testAsyncOpen()
+{
+    QOrganizerEvent event;
+    event.setDisplayLabel(QStringLiteral("Test async open"));
+    event.setStartDateTime(QDateTime(QDate(2024, 11, 4),
+                                     QTime(9, 0), QTimeZone("Europe/Paris")));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    QVERIFY(mManager->saveItem(&event));
+
+    QMap<QString, QString> parameters;
+    parameters.insert(QStringLiteral("databaseName"), QStringLiteral("db"));
+    parameters.insert(QStringLiteral("asyncOpen"), QStringLiteral("true"));
+    QOrganizerManager manager(QString::fromLatin1("mkcal"), parameters);
+    QCOMPARE(manager.error(), QOrganizerManager::NoError);
+
+    // Started before the storage is opened, run once it is.
+    QOrganizerItemFetchRequest request;
+    request.setManager(&manager);
+    request.setStartDate(event.startDateTime().addDays(-1));
+    request.setEndDate(event.startDateTime().addDays(1));
+    QVERIFY(request.start());
+    QVERIFY(request.waitForFinished());
+    QCOMPARE(request.error(), QOrganizerManager::NoError);
+    bool found = false;
+    for (const QOrganizerItem &item : request.items()) {
+        found = found || item.id() == event.id();
+    }
+    QVERIFY(found);
+
+    QCOMPARE(manager.defaultCollectionId(), mManager->defaultCollectionId());
+    QCOMPARE(manager.collections().count(), mManager->collections().count());
+
+    QVERIFY(mManager->removeItem(event.id()));
+}
+
+void tst_engine::testAsyncOpenReady()
+{
+    mKCalOptions options;
+    options.asyncOpen = true;
+    mKCalEngine engine(QTimeZone(), QStringLiteral("db"), options);
+    QSignalSpy ready(&engine, &mKCalEngine::ready);
+
+    // Getters wait for the worker without running an event loop.
+    QVERIFY(!engine.defaultCollectionId().isNull());
+    QCOMPARE(ready.count(), 0);
+    QTRY_COMPARE(ready.count(), 1);
+    QCOMPARE(ready.first().first().toBool(), true);
+
+    // Failures are reported to manager clients too.
+    QMap<QString, QString> parameters;
+    parameters.insert(QStringLiteral("databaseName"),
+                      QStringLiteral("/proc/tst_engine/db"));
+    parameters.insert(QStringLiteral("asyncOpen"), QStringLiteral("true"));
+    QOrganizerManager manager(QString::fromLatin1("mkcal"), parameters);
+    QCOMPARE(manager.error(), QOrganizerManager::NoError);
+    QSignalSpy dataChanged(&manager, &QOrganizerManager::dataChanged);
+    QTRY_COMPARE(dataChanged.count(), 1);
+    manager.collections();
+    QCOMPARE(manager.error(), QOrganizerManager::PermissionsError);
+}
+
+void tst_engine::testSharedWorker()
+{
+    QMap<QString, QString> parameters;
+    parameters.insert(QStringLiteral("databaseName"), QStringLiteral("db"));
+    QOrganizerManager manager(QString::fromLatin1("mkcal"), parameters);
+    QCOMPARE(manager.error(), QOrganizerManager::NoError);
+    QCOMPARE(manager.defaultCollectionId(), mManager->defaultCollectionId());
+
+    QSignalSpy added(&manager, &QOrganizerManager::itemsAdded);
+    QSignalSpy removed(&manager, &QOrganizerManager::itemsRemoved);
+
+    QOrganizerEvent event;
+    event.setDisplayLabel(QStringLiteral("Test shared worker"));
+    event.setStartDateTime(QDateTime(QDate(2024, 11, 5),
+                                     QTime(9, 0), QTimeZone("Europe/Paris")));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    QVERIFY(mManager->saveItem(&event));
+    QTRY_COMPARE(added.count(), 1);
+    QCOMPARE(added.first().first().value<QList<QOrganizerItemId>>(),
+             QList<QOrganizerItemId>() << event.id());
+    QCOMPARE(manager.item(event.id()).displayLabel(), event.displayLabel());
+
+    QVERIFY(manager.removeItem(event.id()));
+    QTRY_COMPARE(removed.count(), 1);
+    QVERIFY(mManager->item(event.id()).isEmpty());
+
+    // Engines of this binary don't share the plugin registry,
+    // check the sharing itself with direct engines.
+    QOrganizerManager::Error error = QOrganizerManager::NoError;
+    mKCalEngine engine1(QTimeZone(), QStringLiteral("db"));
+    QCOMPARE(engine1.memoryReport(&error).clientCount, 1);
+    {
+        mKCalEngine engine2(QTimeZone(), QStringLiteral("db"));
+        QCOMPARE(engine1.memoryReport(&error).clientCount, 2);
+        QCOMPARE(engine2.memoryReport(&error).clientCount, 2);
+
+        mKCalOptions options;
+        options.writeBehind = true;
+        mKCalEngine engine3(QTimeZone(), QStringLiteral("db"), options);
+        QCOMPARE(engine3.memoryReport(&error).clientCount, 1);
+    }
+    QCOMPARE(engine1.memoryReport(&error).clientCount, 1);
+}
+
+void tst_engine::testSharedWorkerSubscriptions()
+{
+    QOrganizerCollection collection1;
+    collection1.setMetaData(QOrganizerCollection::KeyName,
+                            QStringLiteral("Test shared subscription 1"));
+    QVERIFY(mManager->saveCollection(&collection1));
+    QOrganizerCollection collection2;
+    collection2.setMetaData(QOrganizerCollection::KeyName,
+                            QStringLiteral("Test shared subscription 2"));
+    QVERIFY(mManager->saveCollection(&collection2));
+
+    mKCalEngine engine1(QTimeZone(), QStringLiteral("db"));
+    mKCalEngine engine2(QTimeZone(), QStringLiteral("db"));
+    mKCalEngine engine3(QTimeZone(), QStringLiteral("db"));
+    QOrganizerManager::Error error = QOrganizerManager::NoError;
+    QCOMPARE(engine1.memoryReport(&error).clientCount, 3);
+    QVERIFY(engine1.subscribe(QList<QOrganizerCollectionId>() << collection1.id(),
+                              QDateTime(), QDateTime(),
+                              QList<QOrganizerItemType::ItemType>(), &error) > 0);
+    QVERIFY(engine2.subscribe(QList<QOrganizerCollectionId>() << collection2.id(),
+                              QDateTime(), QDateTime(),
+                              QList<QOrganizerItemType::ItemType>(), &error) > 0);
+
+    QSignalSpy added1(&engine1, &QOrganizerManagerEngine::itemsAdded);
+    QSignalSpy added2(&engine2, &QOrganizerManagerEngine::itemsAdded);
+    QSignalSpy added3(&engine3, &QOrganizerManagerEngine::itemsAdded);
+
+    QOrganizerEvent event;
+    event.setDisplayLabel(QStringLiteral("Test shared subscription"));
+    event.setStartDateTime(QDateTime(QDate(2024, 11, 6),
+                                     QTime(9, 0), QTimeZone("Europe/Paris")));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    QList<QOrganizerItem> items;
+    event.setCollectionId(collection1.id());
+    items << event;
+    event.setCollectionId(collection2.id());
+    items << event;
+    QMap<int, QOrganizerManager::Error> errors;
+    QVERIFY(engine3.saveItems(&items, QList<QOrganizerItemDetail::DetailType>(),
+                              &errors, &error));
+
+    // Each subscribed engine is notified of its own items only.
+    QTRY_COMPARE(added3.count(), 1);
+    QCOMPARE(added3.first().first().value<QList<QOrganizerItemId>>().count(), 2);
+    QTRY_COMPARE(added1.count(), 1);
+    QCOMPARE(added1.first().first().value<QList<QOrganizerItemId>>(),
+             QList<QOrganizerItemId>() << items[0].id());
+    QTRY_COMPARE(added2.count(), 1);
+    QCOMPARE(added2.first().first().value<QList<QOrganizerItemId>>(),
+             QList<QOrganizerItemId>() << items[1].id());
+
+    QVERIFY(mManager->removeCollection(collection1.id()));
+    QVERIFY(mManager->removeCollection(collection2.id()));
+}
+
+void tst_engine::testImportItems()
+{
+    QOrganizerCollection collection;
+    collection.setMetaData(QOrganizerCollection::KeyName,
+                           QStringLiteral("Test import"));
+    QVERIFY(mManager->saveCollection(&collection));
+
+    QByteArray data("BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//tst_engine//EN\r\n");
+    for (int i = 0; i < 5; i++) {
+        data += "BEGIN:VEVENT\r\n";
+        data += QStringLiteral("UID:tst-import-%1\r\n").arg(i).toUtf8();
+        data += QStringLiteral("SUMMARY:Test imported event %1\r\n").arg(i).toUtf8();
+        data += QStringLiteral("DTSTART:202411%1T090000Z\r\n").arg(10 + i).toUtf8();
+        data += QStringLiteral("DTEND:202411%1T100000Z\r\n").arg(10 + i).toUtf8();
+        data += "END:VEVENT\r\n";
+    }
+    data += "END:VCALENDAR\r\n";
+    QBuffer buffer(&data);
+
+    // The extensions are not reachable through QOrganizerManager.
+    mKCalEngine engine(QTimeZone(), QStringLiteral("db"));
+    QVERIFY(engine.isOpened());
+    QOrganizerManager::Error error = QOrganizerManager::NoError;
+    QCOMPARE(engine.importItems(&buffer, collection.id(), &error, 2), 5);
+    QCOMPARE(error, QOrganizerManager::NoError);
+
+    // Committed chunks are not kept in memory.
+    const MemoryReport report = engine.memoryReport(&error);
+    QCOMPARE(error, QOrganizerManager::NoError);
+    QCOMPARE(report.eventCount, 0);
+
+    // Importing again updates the stored items in place.
+    QVERIFY(buffer.seek(0));
+    QCOMPARE(engine.importItems(&buffer, collection.id(), &error, 2), 5);
+    QCOMPARE(error, QOrganizerManager::NoError);
+    DbObserver observer;
+    QCOMPARE(observer.deletedCount(collection.id()), 0);
+
+    QOrganizerItemCollectionFilter filter;
+    filter.setCollectionId(collection.id());
+    const QList<QOrganizerItem> items
+        = engine.items(filter,
+                       QDateTime(QDate(2024, 11, 1), QTime(0, 0), Qt::UTC),
+                       QDateTime(QDate(2024, 12, 1), QTime(0, 0), Qt::UTC),
+                       -1, QList<QOrganizerItemSortOrder>(),
+                       QOrganizerItemFetchHint(), &error);
+    QCOMPARE(error, QOrganizerManager::NoError);
+    QCOMPARE(items.count(), 5);
+    for (const QOrganizerItem &item : items) {
+        QVERIFY(item.displayLabel().startsWith(QStringLiteral("Test imported event")));
+    }
+
+    QVERIFY(mManager->removeCollection(collection.id()));
+}
+
+void tst_engine::testMemoryReport()
+{
+    mKCalEngine engine(QTimeZone(), QStringLiteral("db"));
+    QVERIFY(engine.isOpened());
+
+    QOrganizerEvent event;
+    event.setDisplayLabel(QStringLiteral("Test memory report"));
+    event.setStartDateTime(QDateTime(QDate(2024, 12, 2),
+                                     QTime(9, 0), QTimeZone("Europe/Paris")));
+    event.setEndDateTime(event.startDateTime().addSecs(3600));
+    QOrganizerRecurrenceRule rule;
+    rule.setFrequency(QOrganizerRecurrenceRule::Weekly);
+    rule.setLimit(4);
+    QOrganizerItemRecurrence recur;
+    recur.setRecurrenceRules(QSet<QOrganizerRecurrenceRule>() << rule);
+    event.saveDetail(&recur);
+    QOrganizerTodo todo;
+    todo.setDisplayLabel(QStringLiteral("Test memory report todo"));
+    todo.setDueDateTime(QDateTime(QDate(2024, 12, 3),
+                                  QTime(18, 0), QTimeZone("Europe/Paris")));
+
+    QList<QOrganizerItem> items;
+    items << event << todo;
+    QMap<int, QOrganizerManager::Error> errors;
+    QOrganizerManager::Error error = QOrganizerManager::NoError;
+    QVERIFY(engine.saveItems(&items, QList<QOrganizerItemDetail::DetailType>(),
+                             &errors, &error));
+    QList<QOrganizerItemId> ids;
+    ids << items[0].id() << items[1].id();
+
+    MemoryReport report = engine.memoryReport(&error);
+    QCOMPARE(error, QOrganizerManager::NoError);
+    QVERIFY(report.eventCount >= 1);
+    QVERIFY(report.todoCount >= 1);
+    QVERIFY(report.recurringCount >= 1);
+    QVERIFY(report.estimatedBytes > 0);
+
+    const QDate start(2024, 12, 1);
+    const QDate end(2025, 1, 1);
+    engine.items(QOrganizerItemFilter(),
+                 QDateTime(start, QTime(0, 0), Qt::UTC),
+                 QDateTime(end, QTime(0, 0), Qt::UTC),
+                 -1, QList<QOrganizerItemSortOrder>(),
+                 QOrganizerItemFetchHint(), &error);
+    QCOMPARE(error, QOrganizerManager::NoError);
+
+    report = engine.memoryReport(&error);
+    QCOMPARE(error, QOrganizerManager::NoError);
+    bool covered = false;
+    for (const QPair<QDate, QDate> &range : report.loadedRanges) {
+        covered = covered
+            || ((!range.first.isValid() || range.first <= start)
+                && (!range.second.isValid() || range.second >= end.addDays(-1)));
+    }
+    QVERIFY(covered);
+
+    QVERIFY(engine.removeItems(ids, &errors, &error));
+}
+
+void tst_engine::testMemoryReportLog()
+{
+    // The only way for manager clients to get the report.
+    QMap<QString, QString> parameters;
+    parameters.insert(QStringLiteral("databaseName"), QStringLiteral("db"));
+    parameters.insert(QStringLiteral("memoryReportInterval"), QStringLiteral("150"));
+    QTest::ignoreMessage(QtInfoMsg, QRegularExpression(QStringLiteral("^mKCal worker: \\d+ events")));
+    QOrganizerManager manager(QString::fromLatin1("mkcal"), parameters);
+    QCOMPARE(manager.error(), QOrganizerManager::NoError);
+    QTest::qWait(220);
+}
+
 QTEST_MAIN(tst_engine)
+#include "tst_engine.moc"